@@ -0,0 +1,49 @@
+#!/bin/sh
+# Times each interpreter binary given on the command line on loop-heavy
+# scripts (examples/loop.tsp scaled up, plus an arithmetic loop) and prints
+# the best of five runs. The JIT and the .tspc cache are off, so the
+# time is spent in the dispatch loop being compared.
+set -e
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+# examples/loop.tsp with the count raised and the output kept out of the way.
+cat > "$dir/loop.tsp" <<'EOF'
+let n = 0;
+loop 5000000:
+    let n = n + 1;
+end
+println(n);
+EOF
+
+cat > "$dir/arith.tsp" <<'EOF'
+let x = 0;
+let y = 7;
+loop 5000000:
+    let x = x + y * 3 - (x & 255) + 1;
+    let y = (y << 1) % 1000 | 1;
+end
+println(x);
+EOF
+
+best() {
+    b=""
+    for i in 1 2 3 4 5; do
+	s=$(date +%s%N)
+	"$1" --no-jit --no-cache "$2" > /dev/null
+	e=$(date +%s%N)
+	t=$(( (e - s) / 1000000 ))
+	if [ -z "$b" ] || [ "$t" -lt "$b" ]; then b=$t; fi
+    done
+    echo "$b"
+}
+
+printf "%-12s" "script"
+for bin in "$@"; do printf "%28s" "$bin"; done
+printf "\n"
+for script in loop arith; do
+    printf "%-12s" "$script"
+    for bin in "$@"; do printf "%25s ms" "$(best "$bin" "$dir/$script.tsp")"; done
+    printf "\n"
+done
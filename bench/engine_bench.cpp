@@ -0,0 +1,70 @@
+// Throughput of one compiled Program run on many Isolates at once. Each
+// thread owns an Isolate and runs the script back to back; with no shared
+// mutable state, runs/s should grow with the thread count up to the number
+// of cores.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <engine.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static const char* script =
+    "func fib(n):\n"
+    "    if n <= 1:\n"
+    "        return n;\n"
+    "    end\n"
+    "    return fib(n - 1) + fib(n - 2);\n"
+    "end\n"
+    "let acc = 0;\n"
+    "loop 20000:\n"
+    "    let acc = (acc * 31 + 7) % 1000003;\n"
+    "end\n"
+    "println(fib(18), acc);\n";
+
+int main(int argc, char** argv) {
+    int runs_per_thread = argc > 1 ? std::stoi(argv[1]) : 200;
+    int cores           = std::max(1u, std::thread::hardware_concurrency());
+    int max_threads     = argc > 2 ? std::stoi(argv[2]) : cores;
+    std::vector<int> counts;
+    for (int n = 1; n < max_threads; n *= 2) {
+	counts.push_back(n);
+    }
+    counts.push_back(max_threads);
+
+    Tisp::Engine engine;
+    auto         program  = engine.compile("<engine_bench>", script);
+    std::string  expected = Tisp::Isolate(program).run();
+
+    printf("engine_bench: %d runs per thread, %d cores\n", runs_per_thread, cores);
+    double base = 0;
+    for (int threads : counts) {
+	std::atomic<int>         mismatches = 0;
+	std::vector<std::thread> pool;
+	auto                     t0 = Clock::now();
+	for (int t = 0; t < threads; t++) {
+	    pool.emplace_back([&]() {
+		Tisp::Isolate isolate(program);
+		for (int r = 0; r < runs_per_thread; r++) {
+		    mismatches += isolate.run() != expected;
+		}
+	    });
+	}
+	for (auto& thread : pool) {
+	    thread.join();
+	}
+	double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+	double rate = threads * runs_per_thread / secs;
+	if (threads == 1) base = rate;
+	printf("  %3d threads  %9.0f runs/s  %5.2fx\n", threads, rate, rate / base);
+	if (mismatches) {
+	    printf("  %d runs printed the wrong output\n", mismatches.load());
+	    return 1;
+	}
+    }
+    return 0;
+}
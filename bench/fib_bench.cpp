@@ -0,0 +1,88 @@
+// Call-heavy workloads built on the README's fib: naive recursive fib for
+// call/return cost, and a tail-recursive countdown that must run in constant
+// frame space. Each is timed on the bytecode VM and the tree-walker.
+#include <chrono>
+#include <compiler.hpp>
+#include <cstdio>
+#include <lexer.hpp>
+#include <optimizer.hpp>
+#include <parser.hpp>
+#include <resolver.hpp>
+#include <string>
+#include <vm.hpp>
+
+using namespace Tisp::Language;
+using namespace Tisp::Runtime;
+using Clock = std::chrono::steady_clock;
+
+static const char* fib_src =
+    "func fib(n):\n"
+    "    if n <= 1:\n"
+    "        return n;\n"
+    "    end\n"
+    "    return fib(n - 1) + fib(n - 2);\n"
+    "end\n"
+    "let r = fib(@N);\n";
+
+static const char* tail_src =
+    "func count(n, acc):\n"
+    "    if n == 0:\n"
+    "        return acc;\n"
+    "    end\n"
+    "    return count(n - 1, acc + 1);\n"
+    "end\n"
+    "let r = count(@N, 0);\n";
+
+// Best-of-`runs` wall time in ms for one script, with @N substituted.
+static double time_script(const char* name, std::string src, long n, bool tree_walk, int runs) {
+    src.replace(src.find("@N"), 2, std::to_string(n));
+    double best = 1e30;
+    for (int r = 0; r < runs; r++) {
+	Tisp::SourceManager sources;
+	int          file = sources.add(name, src);
+	ErrorManager em(&sources);
+	Lexer        lexer(&sources, file);
+	lexer.error_manager = &em;
+	Tokens   toks = lexer.parse();
+	Parser   parser(toks, &em);
+	Node     program = parser.parse();
+	Resolver resolver(&em);
+	resolver.resolve(program);
+	Optimizer optimizer(*program.arena);
+	optimizer.optimize(program);
+	Vm   vm(std::move(program), &em);
+	auto t0 = Clock::now();
+	if (tree_walk) {
+	    vm.execute();
+	} else {
+	    Compiler compiler(&em);
+	    Chunk    chunk = compiler.compile(vm.program);
+	    vm.run(chunk);
+	}
+	best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - t0).count());
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    long fib_n  = argc > 1 ? std::stol(argv[1]) : 25;
+    long tail_n = argc > 2 ? std::stol(argv[2]) : 1000000;
+    int  runs   = 5;
+    // fib(n) makes about 2 * fib(n + 1) calls.
+    double a = 0, b = 1;
+    for (long i = 0; i <= fib_n; i++) {
+	double c = a + b;
+	a        = b;
+	b        = c;
+    }
+    double calls = 2 * a - 1;
+    printf("fib_bench: fib(%ld) = %.0f calls, tail count(%ld)\n", fib_n, calls, tail_n);
+    for (bool tree_walk : {false, true}) {
+	const char* mode = tree_walk ? "tree-walk" : "bytecode";
+	double      fib  = time_script("<fib>", fib_src, fib_n, tree_walk, runs);
+	double      tail = time_script("<tail>", tail_src, tail_n, tree_walk, runs);
+	printf("  %-9s  fib %8.2f ms  %6.1f ns/call   tail %8.2f ms  %6.1f ns/call\n", mode, fib, fib * 1e6 / calls,
+	       tail, tail * 1e6 / tail_n);
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+// Loading a script that imports many generated modules, timed with 1, 2,
+// 4 ... N scheduler threads (set through TISP_THREADS). Every module also
+// imports one shared file, which must still be parsed only once.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <module.hpp>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+using namespace Tisp::Language;
+using Clock = std::chrono::steady_clock;
+namespace fs = std::filesystem;
+
+static void write_modules(const fs::path& dir, int modules, int statements) {
+    std::ofstream(dir / "common.tsp") << "let shared = 1;\n";
+    std::ofstream root(dir / "main.tsp");
+    for (int m = 0; m < modules; m++) {
+	std::string   name = "m" + std::to_string(m);
+	std::ofstream out(dir / (name + ".tsp"));
+	out << "import common;\n";
+	for (int i = 0; i < statements; i++) {
+	    out << "let " << name << "_" << i % 32 << " = " << i << " + shared * 3 - 2;\n";
+	}
+	out << "func " << name << "(x): return x + " << m << "; end\n";
+	root << "import " << name << ";\n";
+    }
+    root << "println(m0(1));\n";
+}
+
+static double time_load(const fs::path& script, int threads, int runs, size_t& files) {
+    setenv("TISP_THREADS", std::to_string(threads).c_str(), 1);
+    double best = 1e300;
+    for (int r = 0; r < runs; r++) {
+	Tisp::SourceManager sources;
+	ErrorManager        em(&sources);
+	auto                t0   = Clock::now();
+	int                 file = sources.load(script.string());
+	ModuleLoader        loader(&sources, &em);
+	Node                program = loader.load(file);
+	best  = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - t0).count());
+	files = sources.files.size();
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    int  modules     = argc > 1 ? std::stoi(argv[1]) : 64;
+    int  statements  = argc > 2 ? std::stoi(argv[2]) : 5000;
+    int  cores       = std::max(1u, std::thread::hardware_concurrency());
+    int  max_threads = argc > 3 ? std::stoi(argv[3]) : cores;
+    fs::path dir     = fs::temp_directory_path() / ("tisp-modules-" + std::to_string(getpid()));
+    fs::create_directories(dir);
+    write_modules(dir, modules, statements);
+    size_t files = 0;
+    printf("module_bench: %d modules x %d statements, %d cores\n", modules, statements, cores);
+    double base = 0;
+    for (int threads = 1;; threads = std::min(threads * 2, max_threads)) {
+	double ms = time_load(dir / "main.tsp", threads, 3, files);
+	if (threads == 1) base = ms;
+	printf("  %3d threads  %9.2f ms  %5.2fx  (%zu files)\n", threads, ms, base / ms, files);
+	if (threads == max_threads) break;
+    }
+    fs::remove_all(dir);
+    return 0;
+}
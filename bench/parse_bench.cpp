@@ -0,0 +1,54 @@
+// Parse throughput on large generated scripts: lexes and parses the same
+// in-memory source several times and reports the best run of each phase.
+#include <chrono>
+#include <cstdio>
+#include <lexer.hpp>
+#include <parser.hpp>
+#include <string>
+
+using namespace Tisp::Language;
+using Clock = std::chrono::steady_clock;
+
+static std::string generate(int statements) {
+    std::string src;
+    src.reserve(statements * 40);
+    for (int i = 0; i < statements; i++) {
+	std::string v = "v" + std::to_string(i % 64);
+	switch (i % 4) {
+	case 0: src += "let " + v + " = " + std::to_string(i) + " + 3 - 2;\n"; break;
+	case 1: src += "let " + v + " = " + v + " + " + v + " && 1 || 0;\n"; break;
+	case 2: src += "println(\"value\", " + v + ", " + std::to_string(i) + ");\n"; break;
+	case 3: src += "loop 2:\n    let " + v + " = " + v + " - 1;\nend\n"; break;
+	}
+    }
+    return src;
+}
+
+int main(int argc, char** argv) {
+    int statements = argc > 1 ? std::stoi(argv[1]) : 200000;
+    int runs       = 5;
+    Tisp::SourceManager sources;
+    int file = sources.add("<parse_bench>", generate(statements));
+    ErrorManager em(&sources);
+
+    double best_lex = 1e30, best_parse = 1e30;
+    size_t tokens   = 0;
+    for (int r = 0; r < runs; r++) {
+	Lexer lexer(&sources, file);
+	lexer.error_manager = &em;
+	auto t0 = Clock::now();
+	Tokens toks = lexer.parse();
+	auto t1 = Clock::now();
+	Parser parser(toks, &em);
+	Node program = parser.parse();
+	auto t2 = Clock::now();
+	tokens     = toks.size();
+	best_lex   = std::min(best_lex, std::chrono::duration<double, std::nano>(t1 - t0).count());
+	best_parse = std::min(best_parse, std::chrono::duration<double, std::nano>(t2 - t1).count());
+    }
+    double mb = sources.text(file).size() / (1024.0 * 1024.0);
+    printf("parse_bench: %d statements, %zu tokens, %.1f MiB\n", statements, tokens, mb);
+    printf("  lex    %8.2f ms  %6.2f ns/token  %7.1f MiB/s\n", best_lex / 1e6, best_lex / tokens, mb / (best_lex / 1e9));
+    printf("  parse  %8.2f ms  %6.2f ns/token  %7.1f MiB/s\n", best_parse / 1e6, best_parse / tokens, mb / (best_parse / 1e9));
+    return 0;
+}
@@ -0,0 +1,270 @@
+// Per-phase costs on generated workloads: lexing (ns/token), parsing and
+// compiling (ns/AST node), and running on the bytecode VM with and without
+// the JIT and on the tree-walker (ns/operation, where an operation is one
+// binary operator, assignment or call evaluated). Each phase is timed on its
+// own, best of `runs`. --json and --csv print one record per workload and
+// phase, for diffing results across commits.
+#include <chrono>
+#include <compiler.hpp>
+#include <cstdio>
+#include <cstring>
+#include <lexer.hpp>
+#include <optimizer.hpp>
+#include <parser.hpp>
+#include <resolver.hpp>
+#include <string>
+#include <vector>
+#include <vm.hpp>
+
+using namespace Tisp::Language;
+using namespace Tisp::Runtime;
+using Clock = std::chrono::steady_clock;
+
+struct Workload {
+    const char* name;
+    std::string source;
+    uint64_t    ops;
+};
+
+struct Result {
+    const char* workload;
+    const char* phase;
+    const char* unit;
+    uint64_t    count;
+    double      ns;
+};
+
+static const char* binary_ops[] = {" + ", " - ", " & ", " | "};
+
+static std::vector<Workload> workloads(int scale) {
+    std::vector<Workload> all;
+
+    // Fully parenthesized expressions 32 operators deep, nesting on
+    // alternate sides.
+    {
+	int         depth = 32, statements = 2000 * scale;
+	std::string expr  = "x";
+	for (int d = 1; d <= depth; d++) {
+	    std::string n = std::to_string(d);
+	    expr = d % 2 ? "(" + expr + binary_ops[d % 4] + n + ")" : "(" + n + binary_ops[d % 4] + expr + ")";
+	}
+	std::string src = "let x = 5;\n";
+	for (int i = 0; i < statements; i++) {
+	    src += "let x = " + expr + ";\n";
+	}
+	all.push_back({"deep_expr", src, uint64_t(statements) * (depth + 1) + 1});
+    }
+
+    // One long loop over a small body.
+    {
+	int n = 500000 * scale;
+	all.push_back({"long_loop",
+		       "let x = 0;\nlet y = 0;\nloop " + std::to_string(n) + ":\n    let x = x + 3;\n    let y = x & 255;\nend\n",
+		       uint64_t(n) * 4 + 2});
+    }
+
+    // Straight-line `let`s over a few thousand globals.
+    {
+	int         statements = 50000 * scale;
+	std::string src;
+	for (int i = 0; i < 4096; i++) {
+	    src += "let v" + std::to_string(i) + " = " + std::to_string(i) + ";\n";
+	}
+	for (int i = 0; i < statements; i++) {
+	    src += "let v" + std::to_string(i % 4096) + " = v" + std::to_string((i * 7) % 4096) + " + " +
+		   std::to_string(i % 100) + ";\n";
+	}
+	all.push_back({"many_lets", src, 4096 + uint64_t(statements) * 2});
+    }
+
+    // Output-bound: a println of three values per iteration.
+    {
+	int n = 100000 * scale;
+	all.push_back({"println",
+		       "let i = 0;\nloop " + std::to_string(n) + ":\n    println(\"row\", i, i * 3);\n    let i = i + 1;\nend\n",
+		       uint64_t(n) * 4 + 1});
+    }
+    return all;
+}
+
+static uint64_t count_body(NodeBody* body);
+
+static uint64_t count_expr(NodeExpr* expr) {
+    switch (expr->kind) {
+    case ExprKind::Bin: {
+	auto nbin = static_cast<NodeBin*>(expr);
+	return 1 + count_expr(nbin->lhs) + count_expr(nbin->rhs);
+    }
+    case ExprKind::Call: {
+	auto     ncall = static_cast<NodeCall*>(expr);
+	uint64_t n     = 1 + count_expr(ncall->callee);
+	for (auto arg : ncall->args) n += count_expr(arg);
+	return n;
+    }
+    case ExprKind::If: {
+	auto nif = static_cast<NodeIf*>(expr);
+	return 1 + count_expr(nif->condition) + count_body(nif->then_body) + (nif->else_body ? count_body(nif->else_body) : 0);
+    }
+    case ExprKind::Loop: {
+	auto nloop = static_cast<NodeLoop*>(expr);
+	return 1 + count_expr(nloop->times) + count_body(nloop->body);
+    }
+    case ExprKind::Block: {
+	auto nblock = static_cast<NodeBlock*>(expr);
+	return 1 + count_body(nblock->body) + (nblock->value ? count_expr(nblock->value) : 0);
+    }
+    default:
+	return 1;
+    }
+}
+
+static uint64_t count_body(NodeBody* body) {
+    uint64_t n = 1;
+    for (auto stmt : body->stmts) {
+	n++;
+	switch (stmt->kind) {
+	case StmtKind::Assignment: n += count_expr(std::get<NodeAssignment*>(stmt->stmt)->expr); break;
+	case StmtKind::Expr:       n += count_expr(std::get<NodeExprStmt*>(stmt->stmt)->expr); break;
+	case StmtKind::Function:   n += count_body(std::get<NodeFunction*>(stmt->stmt)->body); break;
+	case StmtKind::Return: {
+	    auto value = std::get<NodeReturn*>(stmt->stmt)->value;
+	    if (value) n += count_expr(value);
+	} break;
+	default: break;
+	}
+    }
+    return n;
+}
+
+// A source loaded into its own SourceManager, lexed and parsed.
+struct Parsed {
+    Tisp::SourceManager sources;
+    int                 file;
+    ErrorManager        em;
+    Tokens              tokens;
+    Node                program;
+
+    explicit Parsed(const std::string& src) : file(sources.add("<phase_bench>", src)), em(&sources) {
+	Lexer lexer(&sources, file);
+	lexer.error_manager = &em;
+	tokens              = lexer.parse();
+	Parser parser(tokens, &em);
+	program = parser.parse();
+    }
+};
+
+static double elapsed_ns(Clock::time_point since) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - since).count();
+}
+
+static void run_workload(const Workload& w, int runs, std::vector<Result>& results) {
+    double   lex = 1e30, parse = 1e30, compile = 1e30, vm = 1e30, jit = 1e30, tree = 1e30;
+    uint64_t tokens = 0, nodes = 0;
+    for (int r = 0; r < runs; r++) {
+	Tisp::SourceManager sources;
+	int                 file = sources.add("<phase_bench>", w.source);
+	ErrorManager        em(&sources);
+	Lexer               lexer(&sources, file);
+	lexer.error_manager = &em;
+	auto   t0   = Clock::now();
+	Tokens toks = lexer.parse();
+	lex         = std::min(lex, elapsed_ns(t0));
+	Parser parser(toks, &em);
+	t0           = Clock::now();
+	Node program = parser.parse();
+	parse        = std::min(parse, elapsed_ns(t0));
+	tokens       = toks.size();
+	nodes        = count_body(std::get<NodeBody*>(program.stmt->stmt));
+
+	t0 = Clock::now();
+	Resolver resolver(&em);
+	resolver.resolve(program);
+	Optimizer optimizer(*program.arena);
+	optimizer.optimize(program);
+	Compiler compiler(&em);
+	Chunk    chunk = compiler.compile(program);
+	compile        = std::min(compile, elapsed_ns(t0));
+    }
+    // Output goes to a string so the terminal isn't what gets measured.
+    for (int mode = 0; mode < 3; mode++) {
+	for (int r = 0; r < runs; r++) {
+	    Parsed   p(w.source);
+	    Resolver resolver(&p.em);
+	    resolver.resolve(p.program);
+	    Optimizer optimizer(*p.program.arena);
+	    optimizer.optimize(p.program);
+	    std::string sink;
+	    Vm          machine(std::move(p.program), &p.em);
+	    machine.out.sink    = &sink;
+	    machine.jit.enabled = mode == 1;
+	    Clock::time_point t0;
+	    if (mode == 2) {
+		t0 = Clock::now();
+		machine.execute();
+		machine.out.flush();
+		tree = std::min(tree, elapsed_ns(t0));
+	    } else {
+		Compiler compiler(&p.em);
+		Chunk    chunk = compiler.compile(machine.program);
+		t0             = Clock::now();
+		machine.run(chunk);
+		machine.out.flush();
+		double& best = mode ? jit : vm;
+		best         = std::min(best, elapsed_ns(t0));
+	    }
+	}
+    }
+    results.push_back({w.name, "lex", "token", tokens, lex});
+    results.push_back({w.name, "parse", "node", nodes, parse});
+    results.push_back({w.name, "compile", "node", nodes, compile});
+    results.push_back({w.name, "vm", "op", w.ops, vm});
+    results.push_back({w.name, "jit", "op", w.ops, jit});
+    results.push_back({w.name, "tree", "op", w.ops, tree});
+}
+
+int main(int argc, char** argv) {
+    enum { Table, Json, Csv } format = Table;
+    int scale = 1, runs = 5;
+    for (int i = 1; i < argc; i++) {
+	if (strcmp(argv[i], "--json") == 0) {
+	    format = Json;
+	} else if (strcmp(argv[i], "--csv") == 0) {
+	    format = Csv;
+	} else {
+	    scale = std::max(1, std::stoi(argv[i]));
+	}
+    }
+
+    std::vector<Result> results;
+    for (auto& w : workloads(scale)) {
+	run_workload(w, runs, results);
+    }
+
+    switch (format) {
+    case Table:
+	printf("phase_bench: scale %d, best of %d\n", scale, runs);
+	for (auto& r : results) {
+	    printf("  %-10s %-8s %9.2f ms  %8.2f ns/%-5s (%llu)\n", r.workload, r.phase, r.ns / 1e6, r.ns / r.count, r.unit,
+		   (unsigned long long)r.count);
+	}
+	break;
+    case Json:
+	printf("[\n");
+	for (size_t i = 0; i < results.size(); i++) {
+	    auto& r = results[i];
+	    printf("  {\"workload\": \"%s\", \"phase\": \"%s\", \"ms\": %.3f, \"unit\": \"%s\", \"count\": %llu, \"ns_per_unit\": %.3f}%s\n",
+		   r.workload, r.phase, r.ns / 1e6, r.unit, (unsigned long long)r.count, r.ns / r.count,
+		   i + 1 < results.size() ? "," : "");
+	}
+	printf("]\n");
+	break;
+    case Csv:
+	printf("workload,phase,ms,unit,count,ns_per_unit\n");
+	for (auto& r : results) {
+	    printf("%s,%s,%.3f,%s,%llu,%.3f\n", r.workload, r.phase, r.ns / 1e6, r.unit, (unsigned long long)r.count,
+		   r.ns / r.count);
+	}
+	break;
+    }
+    return 0;
+}
@@ -0,0 +1,82 @@
+// CPU-bound `ploop` timed with 1, 2, 4 ... N scheduler threads (set through
+// TISP_THREADS). Every iteration does the same integer work, so the speedup
+// should follow the number of cores.
+#include <algorithm>
+#include <chrono>
+#include <compiler.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <lexer.hpp>
+#include <optimizer.hpp>
+#include <parser.hpp>
+#include <resolver.hpp>
+#include <string>
+#include <thread>
+#include <vm.hpp>
+
+using namespace Tisp::Language;
+using namespace Tisp::Runtime;
+using Clock = std::chrono::steady_clock;
+
+static const char* script =
+    "func collatz(n):\n"
+    "    let steps = 0;\n"
+    "    let going = 1;\n"
+    "    loop 1000:\n"
+    "        if going:\n"
+    "            if n == 1:\n"
+    "                let going = 0;\n"
+    "            else:\n"
+    "                if n % 2 == 0:\n"
+    "                    let n = n / 2;\n"
+    "                else:\n"
+    "                    let n = 3 * n + 1;\n"
+    "                end\n"
+    "                let steps = steps + 1;\n"
+    "            end\n"
+    "        end\n"
+    "    end\n"
+    "    return steps;\n"
+    "end\n"
+    "ploop @N as i:\n"
+    "    let s = collatz(i + 1);\n"
+    "end\n";
+
+static double time_run(long n, int threads) {
+    std::string src = script;
+    src.replace(src.find("@N"), 2, std::to_string(n));
+    setenv("TISP_THREADS", std::to_string(threads).c_str(), 1);
+    Tisp::SourceManager sources;
+    int          file = sources.add("<ploop>", src);
+    ErrorManager em(&sources);
+    Lexer        lexer(&sources, file);
+    lexer.error_manager = &em;
+    Tokens   toks = lexer.parse();
+    Parser   parser(toks, &em);
+    Node     program = parser.parse();
+    Resolver resolver(&em);
+    resolver.resolve(program);
+    Optimizer optimizer(*program.arena);
+    optimizer.optimize(program);
+    Vm       vm(std::move(program), &em);
+    Compiler compiler(&em);
+    Chunk    chunk = compiler.compile(vm.program);
+    auto     t0    = Clock::now();
+    vm.run(chunk);
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+int main(int argc, char** argv) {
+    long n           = argc > 1 ? std::stol(argv[1]) : 20000;
+    int  cores       = std::max(1u, std::thread::hardware_concurrency());
+    int  max_threads = argc > 2 ? std::stoi(argv[2]) : cores;
+    printf("ploop_bench: %ld iterations, %d cores\n", n, cores);
+    double base = 0;
+    for (int threads = 1;; threads = std::min(threads * 2, max_threads)) {
+	double ms = time_run(n, threads);
+	if (threads == 1) base = ms;
+	printf("  %3d threads  %9.2f ms  %5.2fx\n", threads, ms, base / ms);
+	if (threads == max_threads) break;
+    }
+    return 0;
+}
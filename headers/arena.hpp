@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace Tisp {
+    namespace Language {
+	// Bump allocator that owns one compilation unit's AST and name text.
+	// Nothing allocated here has its destructor run; everything is released
+	// together when the arena goes away.
+	struct Arena {
+	    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+	    std::vector<char*>                                  blocks;
+	    char*                                               cursor = nullptr;
+	    char*                                               limit  = nullptr;
+	    size_t                                              bytes_used = 0;
+	    std::unordered_map<std::string_view, const char*>  names;
+
+	    Arena() = default;
+	    Arena(const Arena&) = delete;
+	    Arena& operator=(const Arena&) = delete;
+	    ~Arena() {
+		for (char* b : blocks) free(b);
+	    }
+
+	    void* allocate(size_t size, size_t align) {
+		uintptr_t p = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(uintptr_t)(align - 1);
+		if (!cursor || p + size > reinterpret_cast<uintptr_t>(limit)) {
+		    size_t block = size + align > BLOCK_SIZE ? size + align : BLOCK_SIZE;
+		    cursor = static_cast<char*>(malloc(block));
+		    if (!cursor) throw std::bad_alloc();
+		    limit = cursor + block;
+		    blocks.push_back(cursor);
+		    p = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(uintptr_t)(align - 1);
+		}
+		cursor = reinterpret_cast<char*>(p + size);
+		bytes_used += size;
+		return reinterpret_cast<void*>(p);
+	    }
+
+	    template <typename T, typename... A>
+	    T* make(A&&... args) {
+		static_assert(std::is_trivially_destructible_v<T>, "arena nodes are never destroyed");
+		return new (allocate(sizeof(T), alignof(T))) T(std::forward<A>(args)...);
+	    }
+
+	    template <typename T>
+	    T* copy_array(const T* items, size_t count) {
+		if (count == 0) return nullptr;
+		T* out = static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+		memcpy(out, items, sizeof(T) * count);
+		return out;
+	    }
+
+	    // Copies `text` once; later requests for the same text share the copy.
+	    const char* intern(std::string_view text) {
+		auto it = names.find(text);
+		if (it != names.end()) return it->second;
+		char* s = static_cast<char*>(allocate(text.size() + 1, 1));
+		memcpy(s, text.data(), text.size());
+		s[text.size()] = '\0';
+		names.emplace(std::string_view(s, text.size()), s);
+		return s;
+	    }
+	};
+
+	// Arena-backed array of child nodes.
+	template <typename T>
+	struct NodeList {
+	    T*       items = nullptr;
+	    uint32_t count = 0;
+	    T* begin() const { return items; }
+	    T* end() const { return items + count; }
+	    size_t size() const { return count; }
+	    bool empty() const { return count == 0; }
+	    T& operator[](size_t i) const { return items[i]; }
+	};
+    } // namespace Language
+} // namespace Tisp
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <ostream>
+#include <parser.hpp>
+
+namespace Tisp {
+    namespace Language {
+	// Prints the tree as indented s-expressions; resolved slots are shown as
+	// `name#slot`.
+	void dump_ast(const Node& program, std::ostream& out);
+    } // namespace Language
+} // namespace Tisp
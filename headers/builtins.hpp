@@ -1,11 +1,65 @@
 #pragma once
+#include <chrono>
+#include <cstdint>
+#include <string_view>
 #include <value.hpp>
 #include <vector>
 #include <vm.hpp>
 namespace Tisp::Runtime {
 namespace Builtin {
-    Value::ValuePtr println(Vm *vm, std::vector<Value::ValuePtr> args);
-    Value::ValuePtr print(Vm *vm, std::vector<Value::ValuePtr> args);
-    Value::ValuePtr exec(Vm *vm, std::vector<Value::ValuePtr> args);
+    using NativeFn = Value::Value (*)(Vm *vm, Value::Args args);
+
+    struct Native {
+	const char* name;
+	NativeFn    fn;
+    };
+
+    Value::Value println(Vm *vm, Value::Args args);
+    Value::Value print(Vm *vm, Value::Args args);
+    Value::Value exec(Vm *vm, Value::Args args);
+    // Child processes, see ProcessTable.
+    Value::Value spawn(Vm *vm, Value::Args args);
+    Value::Value wait(Vm *vm, Value::Args args);
+    Value::Value stdout_of(Vm *vm, Value::Args args);
+    Value::Value stderr_of(Vm *vm, Value::Args args);
+    Value::Value exec_all(Vm *vm, Value::Args args);
+
+    // Every native callable from a script; call sites store an index into it.
+    inline constexpr Native natives[] = {
+	{"println", println},
+	{"print",   print},
+	{"exec",    exec},
+	{"spawn",   spawn},
+	{"wait",    wait},
+	{"stdout",  stdout_of},
+	{"stderr",  stderr_of},
+	{"exec_all", exec_all},
+    };
+    static_assert(std::size(natives) <= Stats::max_natives);
+
+    // Index of `name` in natives, or -1.
+    inline int32_t find_native(std::string_view name) {
+	for (size_t i = 0; i < std::size(natives); i++) {
+	    if (name == natives[i].name) {
+		return i;
+	    }
+	}
+	return -1;
+    }
 } // namespace Builtin
+
+inline Value::Value Vm::call_native(size_t index, Value::Args args, Span site) {
+    native_site = site;
+#if TISP_STATS
+    NativeStats& counter = stats.natives[index];
+    counter.calls++;
+    if (stats.enabled) {
+	auto         start  = std::chrono::steady_clock::now();
+	Value::Value result = Builtin::natives[index].fn(this, args);
+	counter.ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	return result;
+    }
+#endif
+    return Builtin::natives[index].fn(this, args);
+}
 } // namespace Tisp::Runtime
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstdint>
+#include <error.hpp>
+#include <value.hpp>
+#include <vector>
+
+namespace Tisp {
+    namespace Runtime {
+	// Bumped whenever an opcode or operand encoding changes, so compiled
+	// scripts cached by an older build are recompiled.
+	constexpr uint32_t bytecode_version = 2;
+
+	// One byte per opcode, operands follow inline in little-endian order.
+	enum class OpCode : uint8_t {
+	    Const,       // u16 constant index
+	    Nil,
+	    Pop,
+	    GetLocal,    // u16 slot relative to the current frame
+	    SetLocal,    // u16 slot relative to the current frame
+	    GetGlobal,   // u16 Vm::env slot
+	    SetGlobal,   // u16 Vm::env slot
+	    // Generic binary operators; the first run with two inline ints rewrites
+	    // them in place to the matching *Int opcode below.
+	    Add,
+	    Sub,
+	    Mul,
+	    Div,
+	    Mod,
+	    Shl,
+	    Shr,
+	    Band,
+	    Bor,
+	    Lt,
+	    Le,
+	    Gt,
+	    Ge,
+	    Eq,
+	    Ne,
+	    // Quickened forms, in the same order as the generic ones. They rewrite
+	    // themselves back to the generic opcode when an operand is not an
+	    // inline int or the result leaves the inline range.
+	    AddInt,
+	    SubInt,
+	    MulInt,
+	    DivInt,
+	    ModInt,
+	    ShlInt,
+	    ShrInt,
+	    BandInt,
+	    BorInt,
+	    LtInt,
+	    LeInt,
+	    GtInt,
+	    GeInt,
+	    EqInt,
+	    NeInt,
+	    Jump,        // u32 target
+	    JumpIfFalse, // u32 target, condition stays on the stack
+	    AndJump,     // u32 target; a zero lhs short-circuits to 0, otherwise it is popped
+	    OrJump,      // u32 target; a non-zero lhs short-circuits to 1, otherwise it is popped
+	    ToBool,      // replaces the top int with 0 or 1
+	    LoopEnter,   // u32 exit, pushes the iteration counter
+	    LoopTest,    // u32 exit, pops the counter once it reaches the limit
+	    LoopStep,    // u32 target of the matching LoopTest
+	    LoopTestJit, // u32 exit; a LoopTest whose loop has been compiled by the Jit
+	    ParallelLoop, // u16 body function, u8 n, n * (u16 outer slot, u16 body slot)
+	    CallNative,  // u16 index into Builtin::natives, u8 argc
+	    Call,        // u16 index into Chunk::functions, u8 argc
+	    TailCall,    // u16 index into Chunk::functions, u8 argc; reuses the frame
+	    Return,      // pops the frame, leaving the top value for the caller
+	    Halt,
+	};
+
+	inline OpCode quickened(OpCode op) {
+	    return static_cast<OpCode>(static_cast<uint8_t>(op) + (uint8_t(OpCode::AddInt) - uint8_t(OpCode::Add)));
+	}
+	inline OpCode generic(OpCode op) {
+	    return static_cast<OpCode>(static_cast<uint8_t>(op) - (uint8_t(OpCode::AddInt) - uint8_t(OpCode::Add)));
+	}
+
+	// A compiled `func`. Its frame starts at the first argument and holds
+	// `frame_size` slots; temporaries are pushed above it.
+	struct FunctionInfo {
+	    uint32_t    entry;
+	    uint32_t    frame_size;
+	    uint16_t    arity;
+	    const char* name;
+	};
+
+	struct Chunk {
+	    std::vector<uint8_t>         code;
+	    std::vector<Span>            spans;
+	    std::vector<Value::Value>    constants;
+	    std::vector<FunctionInfo>    functions;
+	    Value::Heap                  heap;
+
+	    void emit(uint8_t byte, Span span) {
+		code.push_back(byte);
+		spans.push_back(span);
+	    }
+	    void emit_op(OpCode op, Span span) {
+		emit(static_cast<uint8_t>(op), span);
+	    }
+	    void emit_u16(uint16_t v, Span span) {
+		emit(v & 0xff, span);
+		emit(v >> 8, span);
+	    }
+	    void emit_u32(uint32_t v, Span span) {
+		for (int i = 0; i < 4; i++) emit((v >> (i * 8)) & 0xff, span);
+	    }
+	    void patch_u32(size_t at, uint32_t v) {
+		for (int i = 0; i < 4; i++) code[at + i] = (v >> (i * 8)) & 0xff;
+	    }
+	    uint16_t read_u16(size_t at) const {
+		return code[at] | (code[at + 1] << 8);
+	    }
+	    uint32_t read_u32(size_t at) const {
+		return code[at] | (code[at + 1] << 8) | (code[at + 2] << 16) | (uint32_t(code[at + 3]) << 24);
+	    }
+	    // Operands hold u16 indices; Compiler::emit_index checks the range.
+	    size_t add_constant(Value::Value value) {
+		constants.push_back(value);
+		return constants.size() - 1;
+	    }
+	    // A private copy for one Vm. run() rewrites code in place (quickening,
+	    // the JIT) and the GC marks constants it finds on the stack, so Vms
+	    // sharing a program each need their own code and heap constants.
+	    Chunk fork() const {
+		Chunk copy;
+		copy.code      = code;
+		copy.spans     = spans;
+		copy.functions = functions;
+		copy.constants.reserve(constants.size());
+		for (auto value : constants) {
+		    if (!value.is_obj()) {
+			copy.constants.push_back(value);
+		    } else if (value.is_int()) {
+			copy.constants.push_back(copy.heap.make_int(value.as_int()));
+		    } else {
+			copy.constants.push_back(copy.heap.intern(value.as_string()));
+		    }
+		}
+		return copy;
+	    }
+	};
+    } // namespace Runtime
+} // namespace Tisp
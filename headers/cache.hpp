@@ -0,0 +1,35 @@
+#pragma once
+
+#include <bytecode.hpp>
+#include <cstdint>
+#include <source.hpp>
+#include <string>
+#include <string_view>
+
+namespace Tisp {
+    namespace Runtime {
+	// Compiled form of a script, stored in a .tspc file next to the source
+	// (or under $TISP_CACHE_DIR). The file is keyed by a hash of the source
+	// text, the bytecode version and the compile options; on a hit it is
+	// mmapped and turned back into a Chunk without lexing or parsing.
+	// Imported files are listed with a hash of their contents, and any
+	// change to one of them is a miss too.
+	struct ScriptCache {
+	    std::string  path;
+	    uint64_t     key        = 0;
+	    uint32_t     frame_size = 0; // global slots, valid after a hit
+	    Chunk        chunk;          // valid after a hit
+	    SourceBuffer mapping;        // function names point into it
+
+	    ScriptCache(const std::string& source_path, std::string_view source, bool optimized);
+
+	    // Fills `chunk` and `frame_size` if a matching cache file exists.
+	    // Spans are pointed at `file`, the id of the freshly loaded source,
+	    // and at the imported files, which are added to `sources`.
+	    bool load(SourceManager& sources, uint16_t file);
+	    // Best effort: a cache that can't be written is simply skipped.
+	    // Every file in `sources` other than `file` was imported by it.
+	    void store(const Chunk& compiled, uint32_t globals, const SourceManager& sources, uint16_t file) const;
+	};
+    } // namespace Runtime
+} // namespace Tisp
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <bytecode.hpp>
+#include <parser.hpp>
+#include <string>
+#include <unordered_map>
+
+namespace Tisp {
+    namespace Runtime {
+	// Lowers the tree produced by Parser::parse into a flat Chunk for Vm::run.
+	struct Compiler {
+	    ErrorManager*                             error_manager;
+	    Chunk                                     chunk;
+	    std::unordered_map<uint64_t, size_t>      string_constants;
+	    std::unordered_map<int64_t, size_t>       int_constants;
+	    std::vector<Language::NodeBin*>           spine;
+	    // `ploop` bodies and their Chunk::functions index, compiled last.
+	    std::vector<std::pair<Language::NodeLoop*, uint16_t>> parallel_bodies;
+
+	    Compiler(ErrorManager* em) : error_manager(em) {}
+	    Chunk compile(Language::Node& program);
+	    void compile_body(Language::NodeBody* body);
+	    void compile_stmt(Language::NodeStmt* stmt);
+	    void compile_expr(Language::NodeExpr* expr);
+	    size_t string_constant(std::string_view text);
+	    size_t int_constant(int64_t number);
+	    void emit_index(size_t index, Span span, const char* what);
+	    OpCode binary_opcode(Language::BinaryOp op);
+	    size_t emit_jump(OpCode op, Span span);
+	    void patch_jump(size_t operand);
+	};
+    } // namespace Runtime
+} // namespace Tisp
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <bytecode.hpp>
+#include <error.hpp>
+#include <memory>
+#include <parser.hpp>
+#include <source.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Tisp {
+    // A compiled script. Nothing in it changes after Engine::compile, so one
+    // Program can be shared by any number of Isolates on any threads.
+    struct Program {
+	// Line tables are built during compile, so diagnostics only read it.
+	mutable SourceManager   sources;
+	Language::Node          ast; // function names in `chunk` point into it
+	Runtime::Chunk          chunk;
+	std::vector<Diagnostic> warnings;
+
+	Program(SourceManager sources, Language::Node ast, Runtime::Chunk chunk)
+	: sources(std::move(sources)), ast(std::move(ast)), chunk(std::move(chunk)) {}
+    };
+
+    // Embedding entry point. Errors are thrown as DiagnosticError instead of
+    // printed, and nothing calls exit().
+    struct Engine {
+	bool optimize = true;
+
+	std::shared_ptr<const Program> compile(const std::string& name, std::string_view source) const;
+	std::shared_ptr<const Program> compile_file(const std::string& path) const;
+    };
+
+    // Runs a shared Program on a Vm of its own. An Isolate is used by one
+    // thread at a time; for parallelism give each thread its own Isolate.
+    struct Isolate {
+	std::shared_ptr<const Program> program;
+	bool                           jit = true;
+
+	explicit Isolate(std::shared_ptr<const Program> program) : program(std::move(program)) {}
+
+	// Runs the program from the top on a fresh Vm and returns everything
+	// it printed. A runtime error throws DiagnosticError.
+	std::string run() const;
+    };
+} // namespace Tisp
@@ -1,18 +1,24 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <sstream>
 #include <iostream>
+#include <source.hpp>
+#include <stdexcept>
 
+// File id and byte range in the SourceManager; line and column are computed
+// only when a diagnostic is printed.
 struct Span {
-    const char* filename;
-    int         line;
-    int         cols;
-    int         cole;
-    Span(const char* f, int l, int sc, int ec) : filename(strdup(f)), line(l), cols(sc), cole(ec) {}
+    uint32_t offset = 0;
+    uint16_t file   = 0;
+    uint16_t length = 0;
+    Span(uint16_t f, uint32_t off, uint32_t len) : offset(off), file(f), length(len > 0xffff ? 0xffff : len) {}
     Span() {}
 };
+static_assert(sizeof(Span) == 8);
 
 enum class DiagnosticType {
     Error,
@@ -34,17 +40,19 @@ struct Diagnostic {
     message(std::move(message)), hint(std::move(help)), ref(ref) {}
 };
 
+// Thrown for a fatal diagnostic when ErrorManager::throw_errors is set, so an
+// embedder gets the error back instead of the process exiting.
+struct DiagnosticError : std::runtime_error {
+    Diagnostic diagnostic;
+    DiagnosticError(Diagnostic d, const std::string& text) : std::runtime_error(text), diagnostic(std::move(d)) {}
+};
+
 struct ErrorManager {
-    std::string              m_source;
-    std::vector<std::string> lines;
+    Tisp::SourceManager*     sources;
     std::vector<Diagnostic>  errors;
+    bool                     throw_errors = false;
 
-    ErrorManager(std::string source): m_source(source) {
-	std::stringstream s;
-	s << source;
-	std::string       line;
-	while(std::getline(s, line)) lines.push_back(line);
-    }
+    ErrorManager(Tisp::SourceManager* sources): sources(sources) {}
     
     void add(Diagnostic d) {
 	this->errors.push_back(d);
@@ -58,26 +66,35 @@ struct ErrorManager {
 	}
 	if (malformed) exit(1);
     }
-    
-    void report(Diagnostic d, bool noreturn) {
-	int ln = d.location.line - 1;
-	int cols = d.location.cols;
-	int cole = d.location.cole;
-	std::string line = lines.at(ln);
+
+    // Renders `d` with its source line, as report() prints it.
+    std::string format(const Diagnostic& d) {
+	Tisp::SourceLocation loc = sources->locate(d.location.file, d.location.offset);
+	std::string_view line = loc.text;
+	int cols = loc.column - 1;
+	int cole = cols + (d.location.length ? d.location.length : 1) - 1;
 	std::string tag  = (d.kind == DiagnosticType::Error) ? "error" : (d.kind == DiagnosticType::Info)? "info": "warning";
-	std::cout << d.location.filename << ":" << ln << ":" << cols << ": " << tag << ": " << d.message << "\n";
-	std::cout << "   |\n";
-	std::cout << ln << "  |  " << line << "\n";
-	std::cout << "   |" << std::string(cols + 1, ' ');
-	for(int i = cols; i < line.size() ; i++) {
-	    if (i <= cole) {
-		std::cout << "^";
-	    }	   
+	std::ostringstream out;
+	out << loc.file << ":" << loc.line << ":" << loc.column << ": " << tag << ": " << d.message << "\n";
+	out << "   |\n";
+	out << loc.line << "  |  " << line << "\n";
+	out << "   |" << std::string(cols + 2, ' ');
+	for(int i = cols; i <= cole && i < (int)line.size(); i++) {
+	    out << "^";
 	}
-	std::cout << "\n";
+	out << "\n";
 	if (d.hint.size() > 0) {
-	    std::cout << "   |" << std::string(cols + 1, ' ') << ":" << d.hint << "\n";
+	    out << "   |" << std::string(cols + 2, ' ') << ":" << d.hint << "\n";
+	}
+	return out.str();
+    }
+
+    void report(Diagnostic d, bool noreturn) {
+	if (noreturn && throw_errors) {
+	    std::string text = format(d);
+	    throw DiagnosticError(std::move(d), text);
 	}
+	std::cout << format(d);
 	if (noreturn)
 	exit(1);
     }
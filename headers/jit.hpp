@@ -0,0 +1,60 @@
+#pragma once
+
+#include <bytecode.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace Tisp {
+    namespace Runtime {
+	// Machine state handed to a compiled loop. `spill` is the loop body's
+	// operand stack (untagged ints); on a bailout its live part is pushed
+	// back onto the VM stack.
+	struct JitState {
+	    static constexpr size_t max_depth = 32;
+
+	    uint64_t* globals;
+	    uint64_t* locals;
+	    int64_t   counter;
+	    int64_t   times;
+	    int64_t   spill[max_depth];
+	};
+
+	// Runs the loop from its LoopTest. Returns the bytecode offset to resume
+	// at in the low 32 bits and the operand stack depth in the high 32 bits.
+	using JitFn = uint64_t (*)(JitState* state);
+
+	struct JitLoop {
+	    JitFn    fn     = nullptr; // null: the loop can't be compiled
+	    uint32_t exit   = 0;
+	    uint32_t deopts = 0;
+	};
+
+	// Baseline JIT for hot `loop` bodies. A loop whose back edge runs
+	// `threshold` times is compiled from its bytecode into x86-64, if every
+	// instruction in the body is one it knows (int arithmetic, comparisons,
+	// slot access, forward branches). The native code keeps ints untagged and
+	// bails out to the interpreter at the current instruction whenever a
+	// value isn't an inline int or a result would leave the inline range.
+	struct Jit {
+	    static constexpr uint32_t threshold  = 1000;
+	    static constexpr uint32_t max_deopts = 16;
+
+	    bool                                         enabled = true;
+	    std::vector<uint32_t>                        hotness;
+	    std::unordered_map<const uint8_t*, JitLoop>  loops;
+	    std::vector<std::pair<void*, size_t>>        regions;
+
+	    Jit() = default;
+	    ~Jit();
+	    Jit(const Jit&) = delete;
+	    Jit& operator=(const Jit&) = delete;
+
+	    // Compiles the loop whose LoopTest is at `test` and whose LoopStep is
+	    // at `step`; returns null when the body can't be compiled (or the
+	    // host isn't x86-64 Linux).
+	    JitFn compile_loop(const Chunk& chunk, size_t test, size_t step);
+	};
+    } // namespace Runtime
+} // namespace Tisp
@@ -1,9 +1,11 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <string.h>
 #include <error.hpp>
+#include <source.hpp>
 
 namespace Tisp {
     namespace Language {
@@ -25,6 +27,7 @@ namespace Tisp {
 	    SUB,      // -
 	    MUL,      // *
 	    DIV,      // /
+	    MOD,      // %
 	    SHR,      // >>
 	    SHL,      // <<
 	    ADDEQ,    // +=
@@ -37,28 +40,51 @@ namespace Tisp {
 	    AND,      // &&
 	    BAND,     // &
 	    BOR,      // |
+	    LT,       // <
+	    LE,       // <=
+	    GT,       // >
+	    GE,       // >=
+	    EQEQ,     // ==
+	    NE,       // !=
 	    TEOF,
 	};
 	
+	// `data` points into the SourceManager's buffer, which must outlive the tokens.
 	struct Token {
-	    TokenKind   kind;
-	    std::string data;
-	    Span        span;
-	    Token(TokenKind k, std::string lexme, Span s): kind(k), data(lexme), span(s) {}
+	    TokenKind        kind;
+	    std::string_view data;
+	    Span             span;
+	    Token(TokenKind k, std::string_view lexme, Span s): kind(k), data(lexme), span(s) {}
 	};
 	
-	typedef std::vector<Token> Tokens;
+	// Token stream laid out as parallel arrays so the parser scans a dense
+	// TokenKind array; text and spans are rebuilt from offset/length on demand.
+	struct Tokens {
+	    uint16_t               file = 0;
+	    std::string_view       source;
+	    std::vector<TokenKind> kinds;
+	    std::vector<uint32_t>  offsets;
+	    std::vector<uint32_t>  lengths;
+
+	    void push(TokenKind k, uint32_t offset, uint32_t length) {
+		kinds.push_back(k);
+		offsets.push_back(offset);
+		lengths.push_back(length);
+	    }
+	    size_t size() const { return kinds.size(); }
+	    std::string_view text(size_t i) const { return source.substr(offsets[i], lengths[i]); }
+	    Span span(size_t i) const { return Span(file, offsets[i], lengths[i]); }
+	    Token at(size_t i) const { return Token(kinds[i], text(i), span(i)); }
+	};
 	
 	struct Lexer {
-	    std::string filename;
-	    std::string source;
-	    ErrorManager*  error_manager;
+	    uint16_t         file;
+	    std::string_view source;
+	    ErrorManager*    error_manager;
 	    
 	    int         pos    = 0;
-	    int         column = 1;
-	    int         line   = 1;
 	    
-	    Lexer(std::string filename);
+	    Lexer(SourceManager* sources, uint16_t file);
 	    char now();
 	    char advance();
 	    char before();
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <error.hpp>
+#include <memory>
+#include <parser.hpp>
+#include <scheduler.hpp>
+#include <source.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Tisp {
+    namespace Language {
+	// Loads a script and every module it imports, directly or not, into
+	// one program. Imports are followed a depth at a time. The files found
+	// at one depth are opened in order on the calling thread, so file ids
+	// don't depend on timing. They are then lexed and parsed in parallel
+	// on a Scheduler. A file imported from several places (a diamond, or
+	// a cycle) is parsed once. In the merged program each module's top
+	// level runs once, after the modules it imports; the root runs last.
+	struct ModuleLoader {
+	    struct Module {
+		std::string             path; // canonical, the key in `modules`
+		int                     file = -1;
+		Node                    ast;
+		std::vector<Module*>    imports;
+		std::vector<Diagnostic> diagnostics;
+		bool                    merged = false;
+	    };
+
+	    SourceManager*                                           sources;
+	    ErrorManager*                                            error_manager;
+	    std::unordered_map<std::string, std::unique_ptr<Module>> modules;
+	    std::unique_ptr<Runtime::Scheduler>                      scheduler;
+
+	    ModuleLoader(SourceManager* sources, ErrorManager* em) : sources(sources), error_manager(em) {}
+
+	    // Parses `root` (already loaded into `sources`) and its imports.
+	    Node load(int root);
+
+	  private:
+	    Module* add(std::string path, int file);
+	    void    parse_all(const std::vector<Module*>& batch);
+	    void    merge(Module* module, std::vector<Stmtptr>& stmts, Node& program);
+	};
+    } // namespace Language
+} // namespace Tisp
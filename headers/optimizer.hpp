@@ -0,0 +1,22 @@
+#pragma once
+
+#include <parser.hpp>
+#include <vector>
+
+namespace Tisp {
+    namespace Language {
+	// AST rewrites that run after the Resolver and before execution:
+	// constant folding of NodeBin trees and removal of `if`/`loop` bodies
+	// that a constant condition or count makes unreachable.
+	struct Optimizer {
+	    Arena&                arena;
+	    std::vector<NodeBin*> spine;
+
+	    Optimizer(Arena& arena) : arena(arena) {}
+	    void optimize(Node& program);
+	    void optimize_body(NodeBody* body);
+	    Exprptr optimize_expr(Exprptr expr);
+	    Exprptr fold_binary(NodeBin* node, Exprptr lhs, Exprptr rhs);
+	};
+    } // namespace Language
+} // namespace Tisp
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <value.hpp>
+#include <vector>
+
+namespace Tisp {
+    namespace Runtime {
+	enum class FlushPolicy {
+	    Size,       // write out whenever the buffer reaches `limit` bytes
+	    Newline,    // also write out at the end of every line
+	    Exit,       // keep everything until flush() or process exit
+	    Unbuffered, // write out after every print call
+	};
+
+	// VM-owned stdout buffer. Values are formatted straight into it and it
+	// is written with write(2), bypassing iostreams. Pending bytes are also
+	// written if the process exits through exit().
+	struct Output {
+	    int               fd     = 1;
+	    FlushPolicy       policy = FlushPolicy::Size;
+	    size_t            limit  = 64 * 1024;
+	    std::vector<char> buffer;
+	    // When set, flush() appends here instead of writing to `fd`.
+	    std::string*      sink = nullptr;
+
+	    Output();
+	    ~Output();
+	    Output(const Output&) = delete;
+	    Output& operator=(const Output&) = delete;
+
+	    void write(std::string_view text);
+	    void write_int(int64_t value);
+	    void write_value(Value::Value value);
+	    // Called by print/println once all of their output is appended.
+	    void end_print(bool newline);
+	    void flush();
+	};
+    } // namespace Runtime
+} // namespace Tisp
@@ -1,8 +1,11 @@
 #pragma once
 #include "value.hpp"
+#include <arena.hpp>
 #include <cstdint>
 #include <lexer.hpp>
 #include <memory>
+#include <string>
+#include <variant>
 #include <vector>
 namespace Tisp {
     namespace Language {
@@ -12,6 +15,7 @@ namespace Tisp {
 	    Program,
 	    Body,
 	    Expr,
+	    Return,
 	    Nop,
 	};
 	enum class ExprKind {
@@ -19,6 +23,10 @@ namespace Tisp {
 	    String,
 	    Call,
 	    Ident,
+	    Bin,
+	    If,
+	    Loop,
+	    Block,
 	    Nop,
 	};
 	struct Node;
@@ -32,88 +40,127 @@ namespace Tisp {
 	struct NodeInt;
 	struct NodeString;
 	struct NodeIdent;
+	struct NodeReturn;
 
-	using Exprptr = std::unique_ptr<NodeExpr>;
-	using Stmtptr = std::unique_ptr<NodeStmt>;
+	using Exprptr = NodeExpr*;
+	using Stmtptr = NodeStmt*;
 
+	// All nodes live in the Arena owned by their Node root, so they must stay
+	// trivially destructible.
 	struct NodeExpr {
-	    Span span;
-	    NodeExpr(Span s): span(s) {}
-	    virtual ~NodeExpr() = default;
+	    ExprKind kind;
+	    Span     span;
+	    NodeExpr(ExprKind k, Span s): kind(k), span(s) {}
 	};
 	
 	struct NodeAssignment {
 	    Span                     span;
 	    const char *             name;
 	    Exprptr                  expr;
+	    // Top-level bindings are globals (Vm::env); the rest are slots in
+	    // the enclosing function's frame.
+	    int32_t                  slot = -1;
+	    bool                     global = false;
 	    NodeAssignment(const char *name, Exprptr expr, Span s)
-	    : name(std::move(name)), expr(std::move(expr)), span(s) {}
+	    : span(s), name(name), expr(expr) {}
 	};
 
 	struct NodeIdent : NodeExpr {
-	    Span                     span;
 	    const char *             identifier;
-	    NodeIdent(const char *name, Span s) : identifier(name), span(s), NodeExpr(s) {}
+	    int32_t                  slot = -1;
+	    bool                     global = false;
+	    NodeIdent(const char *name, Span s) : NodeExpr(ExprKind::Ident, s), identifier(name) {}
 	};
 
 	struct NodeInt : NodeExpr {
-	    Span                     span;
 	    int64_t                  value;
-	    NodeInt(int64_t value, Span s) : value(value), span(s), NodeExpr(s) {}
+	    NodeInt(int64_t value, Span s) : NodeExpr(ExprKind::Int, s), value(value) {}
 	};
 
 	struct NodeString : NodeExpr {
-	    Span                      span;
 	    const char *              value;
-	    NodeString(const char *name, Span s) : value(name), span(s), NodeExpr(s) {}
+	    NodeString(const char *name, Span s) : NodeExpr(ExprKind::String, s), value(name) {}
 	};
 	struct NodeIf     : NodeExpr {
-	    Span                      span;
 	    Exprptr                   condition;
-	    std::unique_ptr<NodeBody> then_body;
-	    std::unique_ptr<NodeBody> else_body;
-	    NodeIf(Exprptr cond, std::unique_ptr<NodeBody> tb, std::unique_ptr<NodeBody> eb, Span s)
-	    : condition(std::move(cond)), then_body(std::move(tb)), else_body(std::move(eb)), span(s), NodeExpr(s) {}
+	    NodeBody*                 then_body;
+	    NodeBody*                 else_body;
+	    NodeIf(Exprptr cond, NodeBody* tb, NodeBody* eb, Span s)
+	    : NodeExpr(ExprKind::If, s), condition(cond), then_body(tb), else_body(eb) {}
 
-	    NodeIf(Exprptr cond, std::unique_ptr<NodeBody> tb, Span s)
-	    : condition(std::move(cond)), then_body(std::move(tb)), span(s), NodeExpr(s) {}
+	    NodeIf(Exprptr cond, NodeBody* tb, Span s)
+	    : NodeExpr(ExprKind::If, s), condition(cond), then_body(tb), else_body(nullptr) {}
+	};
+
+	// An enclosing local copied into a `ploop` body's frame when it starts.
+	struct Capture {
+	    int32_t outer;
+	    int32_t inner;
 	};
 
 	struct NodeLoop   : NodeExpr {
-	    Span                      span;
 	    Exprptr                   times;
-	    std::unique_ptr<NodeBody> body;
-	    NodeLoop(Exprptr t, std::unique_ptr<NodeBody> b, Span s)
-	    : times(std::move(t)), body(std::move(b)), span(s), NodeExpr(s) {}
+	    NodeBody*                 body;
+	    // `ploop N as i:` may run its iterations in parallel. Its body gets a
+	    // frame of its own, filled in by the Resolver: the index in slot 0,
+	    // then captured outer locals and the body's `let`s.
+	    bool                      parallel   = false;
+	    const char*               index      = nullptr;
+	    uint32_t                  frame_size = 0;
+	    NodeList<Capture>         captures;
+	    NodeLoop(Exprptr t, NodeBody* b, Span s)
+	    : NodeExpr(ExprKind::Loop, s), times(t), body(b) {}
+	};
+	
+	// Runs `body` and evaluates to `value`; produced by the Optimizer when an
+	// `if` has a constant condition.
+	struct NodeBlock  : NodeExpr {
+	    NodeBody*                 body;
+	    Exprptr                   value;
+	    NodeBlock(NodeBody* b, Exprptr v, Span s)
+	    : NodeExpr(ExprKind::Block, s), body(b), value(v) {}
 	};
 	
 	struct NodeFunction {
 	    Span                      span;
 	    const char *              name;
-	    std::unique_ptr<NodeBody> body;
-	    NodeFunction(const char *name, std::unique_ptr<NodeBody> body, Span s)
-	    : name(std::move(name)), body(std::move(body)), span(s) {}
+	    NodeList<const char*>     params;
+	    NodeBody*                 body;
+	    // Filled in by the Resolver: position in Node::functions and the
+	    // number of frame slots (parameters first, then `let`s).
+	    int32_t                   index = -1;
+	    uint32_t                  frame_size = 0;
+	    NodeFunction(const char *name, NodeList<const char*> params, NodeBody* body, Span s)
+	    : span(s), name(name), params(params), body(body) {}
+	};
+
+	// `return expr;` (or `return;`, which returns nil).
+	struct NodeReturn {
+	    Span                      span;
+	    Exprptr                   value;
+	    NodeReturn(Exprptr value, Span s) : span(s), value(value) {}
 	};
 
 	struct NodeExprStmt {
 	    Exprptr expr;
-	    explicit NodeExprStmt(Exprptr expr) : expr(std::move(expr)) {}
+	    explicit NodeExprStmt(Exprptr expr) : expr(expr) {}
 	};
 
 	struct NodeBody {
 	    Span                 span;
-	    std::vector<Stmtptr> stmts;
+	    NodeList<Stmtptr>    stmts;
 	};
 
 	struct NodeNop: NodeExpr {
-	    NodeNop(): NodeExpr({}) {}
+	    NodeNop(): NodeExpr(ExprKind::Nop, {}) {}
 	};
 	struct NodeCall: NodeExpr {
-	    Span                 span;
 	    Exprptr              callee;
-	    std::vector<Exprptr> args;
-	    NodeCall(Exprptr callee, std::vector<Exprptr> args, Span s)
-	    : callee(std::move(callee)), args(std::move(args)), span(s), NodeExpr(s) {}
+	    NodeList<Exprptr>    args;
+	    int32_t              native = -1;   // cached Builtin::natives index
+	    int32_t              function = -1; // Node::functions index, set by the Resolver
+	    NodeCall(Exprptr callee, NodeList<Exprptr> args, Span s)
+	    : NodeExpr(ExprKind::Call, s), callee(callee), args(args) {}
 	};
 	enum class BinaryOp {
 	    Add,
@@ -127,13 +174,18 @@ namespace Tisp {
 	    Or,
 	    Band,
 	    Bor,
+	    Lt,
+	    Le,
+	    Gt,
+	    Ge,
+	    Eq,
+	    Ne,
 	};
 	struct NodeBin: NodeExpr {
-	    Span       span;
 	    BinaryOp   op;
 	    Exprptr    lhs;
 	    Exprptr    rhs;
-	    NodeBin(BinaryOp op, Exprptr l, Exprptr r, Span s): op(op), lhs(std::move(l)), rhs(std::move(r)), span(s), NodeExpr(s) {}
+	    NodeBin(BinaryOp op, Exprptr l, Exprptr r, Span s): NodeExpr(ExprKind::Bin, s), op(op), lhs(l), rhs(r) {}
 	};
 	
 	struct NodeStmt {
@@ -143,45 +195,76 @@ namespace Tisp {
 	    std::variant<NodeAssignment*,
             NodeExprStmt*, NodeFunction*,
             NodeBody*, NodeCall*,
-            NodeNop*>;
+            NodeReturn*, NodeNop*>;
 	    StmtVariant stmt;
-	    NodeStmt() : kind(StmtKind::Nop), stmt(new NodeNop()) {}
 	    NodeStmt(Span span, StmtKind kind, StmtVariant stmt)
-	    : kind(kind), span(span), stmt(std::move(stmt)) {}
-	    static Stmtptr make_nop(Span s = {}) {
-		return std::make_unique<NodeStmt>(s, StmtKind::Nop,
-                new NodeNop());
-	    }
+	    : kind(kind), span(span), stmt(stmt) {}
+	};
+
+	// `import util;` (util.tsp) or `import "lib/util.tsp";`, relative to
+	// the importing file.
+	struct Import {
+	    std::string path;
+	    Span        span;
 	};
 
 	struct Node {
-	    Span span;
-	    Stmtptr stmt;
+	    Span                   span;
+	    Stmtptr                stmt = nullptr;
+	    uint32_t               frame_size = 0;
+	    // Every `func`, in definition order, and the index of `main` (or -1).
+	    std::vector<NodeFunction*> functions;
+	    int32_t                main = -1;
+	    std::unique_ptr<Arena> arena;
+	    // This file's imports, in order; the ModuleLoader follows them.
+	    std::vector<Import>    imports;
+	    // Arenas of imported files, whose statements `stmt` also refers to.
+	    std::vector<std::unique_ptr<Arena>> module_arenas;
 	};
 
 	// Parser
 	struct Parser {
-	    Tokens        source;
-	    ErrorManager* error_manager;
-	    int           pos;
-	    Token now();
-	    Token before();
-	    Token peek();
-	    void advance();
+	    const Tokens&          source;
+	    ErrorManager*          error_manager;
+	    int                    pos;
+	    std::unique_ptr<Arena> arena;
+	    // Children of the lists being built; each list is copied into the arena
+	    // once complete so the parser makes no per-list allocation.
+	    std::vector<Stmtptr>   stmt_scratch;
+	    std::vector<Exprptr>   expr_scratch;
+	    // Operators waiting for their right operand in parse_expr; prec 0
+	    // marks an open parenthesis.
+	    struct PendingOp {
+		int      prec;
+		BinaryOp op;
+		Span     span;
+	    };
+	    std::vector<PendingOp> op_scratch;
+	    std::vector<Import>    imports;
+	    // The token stream always ends in TEOF and advance() never moves past it,
+	    // so the accessors index the arrays directly.
+	    TokenKind now_kind() const { return source.kinds[pos]; }
+	    std::string_view now_text() const { return source.text(pos); }
+	    Span now_span() const { return source.span(pos); }
+	    void advance() {
+		if (pos + 1 < (int)source.size()) pos++;
+	    }
 	    Node parse();
 	    Exprptr parse_expr();
-	    Exprptr parse_term();
-	    Exprptr parse_additive();
 	    Exprptr parse_atom();
-	    Exprptr parse_logical_or();
-	    Exprptr parse_logical_and();
 	    
-	    Node parse_func();
-	    std::unique_ptr<NodeBody> parse_body();
+	    void parse_import();
+	    Stmtptr parse_func();
+	    Stmtptr parse_let();
+	    Stmtptr parse_return();
+	    Stmtptr parse_stmt(bool top_level);
+	    NodeBody* parse_body();
+	    NodeBody* finish_body(size_t mark, Span span);
 	    void expect(TokenKind k);
 	    void expect_kw(const char *);
-	    bool match(TokenKind k);
-	    Parser(Tokens source, ErrorManager* em) : source(source), pos(0), error_manager(em) {}
+	    bool match(TokenKind k) const { return now_kind() == k; }
+	    Parser(const Tokens& source, ErrorManager* em)
+	    : source(source), error_manager(em), pos(0), arena(std::make_unique<Arena>()) {}
 	};
     } // namespace Language
 } // namespace Tisp
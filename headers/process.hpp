@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <sys/types.h>
+#include <value.hpp>
+#include <vector>
+
+namespace Tisp {
+    namespace Runtime {
+	// A child started by spawn()/exec_all(). Its stdout and stderr are read
+	// through pipes straight into `out` and `err` as they arrive.
+	struct Process {
+	    pid_t        pid     = -1;
+	    int          out_fd  = -1;
+	    int          err_fd  = -1;
+	    int          status  = 0; // exit code once `exited`
+	    bool         exited  = false;
+	    std::string  out;
+	    std::string  err;
+	    // Set once the captured text has been handed to the script as a
+	    // string value, so it is moved out of the buffer only once.
+	    Value::Value out_value = Value::Value::nil();
+	    Value::Value err_value = Value::Value::nil();
+	};
+
+	// Children of one VM, addressed by the integer handle spawn() returns.
+	struct ProcessTable {
+	    std::vector<Process> procs;
+	    size_t               running = 0;
+	    // Released slots, reused by the next spawn().
+	    std::vector<int>     free;
+
+	    ProcessTable() = default;
+	    ~ProcessTable();
+	    ProcessTable(const ProcessTable&) = delete;
+	    ProcessTable& operator=(const ProcessTable&) = delete;
+
+	    // Starts argv[0] (looked up in PATH, no shell). With `capture` the
+	    // child's stdout/stderr go to pipes, otherwise they are inherited.
+	    // A program that can't be started exits with 127 immediately.
+	    int spawn(const std::vector<std::string>& argv, bool capture);
+	    // Reads whatever output is ready and reaps finished children,
+	    // waiting up to `timeout_ms` (-1: until something happens).
+	    void pump(int timeout_ms);
+	    // Blocks until `handle` has exited and returns its exit code.
+	    int wait(int handle);
+	    // Frees the slot of an exited child whose handle nobody holds any
+	    // more, such as exec()'s; its captured output goes with it.
+	    void release(int handle);
+	    bool valid(int64_t handle) const {
+		return handle >= 0 && handle < int64_t(procs.size());
+	    }
+
+	  private:
+	    int add(Process proc);
+	};
+
+	// Splits a command line on whitespace. There is no quoting; use the
+	// multi-argument form of spawn() for arguments containing spaces.
+	std::vector<std::string> split_command(std::string_view command);
+    } // namespace Runtime
+} // namespace Tisp
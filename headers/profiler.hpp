@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <error.hpp>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <source.hpp>
+#include <string>
+#include <vector>
+
+namespace Tisp {
+    namespace Runtime {
+	// One frame of a sampled call stack: the running function and the
+	// node it was at (the call, for every frame but the innermost).
+	struct ProfileSite {
+	    const char* function;
+	    Span        span;
+
+	    bool operator<(const ProfileSite& o) const {
+		if (function != o.function) return function < o.function;
+		if (span.file != o.span.file) return span.file < o.span.file;
+		return span.offset < o.span.offset;
+	    }
+	};
+
+	// Sampling profiler behind --profile. A SIGPROF timer ticks once per
+	// `interval_us` of CPU time used by the process and only bumps the
+	// running profiler's `pending`. Vms attached to it check that between
+	// instructions (statements in the tree-walker) and record their call
+	// stack there, where reading Vm state is safe; ticks that arrive while
+	// native code runs are all charged to the next sample. Vms without a
+	// profiler never touch the counter. One profiler runs at a time.
+	struct Profiler {
+	    static constexpr long         interval_us = 1000;
+	    std::atomic<uint32_t>         pending{0};
+
+	    std::mutex                                      lock;
+	    uint64_t                                        samples = 0;
+	    std::map<std::vector<ProfileSite>, uint64_t>    stacks; // outermost frame first
+
+	    Profiler() = default;
+	    Profiler(const Profiler&) = delete;
+	    Profiler& operator=(const Profiler&) = delete;
+	    ~Profiler();
+
+	    void start();
+	    void stop();
+	    void record(const std::vector<ProfileSite>& stack, uint32_t ticks);
+	    // file:line table, hottest first: samples spent on the line itself
+	    // and samples with the line anywhere on the stack.
+	    void write_lines(SourceManager& sources, std::ostream& out, size_t limit = 20);
+	    // "frame;frame;frame count" per distinct stack, as read by
+	    // flamegraph.pl, inferno and speedscope.
+	    void write_folded(SourceManager& sources, std::ostream& out);
+
+	  private:
+	    bool running = false;
+	};
+    } // namespace Runtime
+} // namespace Tisp
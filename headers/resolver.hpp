@@ -0,0 +1,41 @@
+#pragma once
+
+#include <parser.hpp>
+#include <string>
+#include <unordered_map>
+
+namespace Tisp {
+    namespace Language {
+	// Gives every `let` binding and parameter a slot and stores it on the
+	// NodeAssignment/NodeIdent nodes, so the runtime never looks names up.
+	// Top-level bindings are globals; inside a `func` they live in its frame.
+	// A `ploop` body is a frame of its own: outer locals it reads are copied
+	// in (captured), and its `let`s never write outside it.
+	// Calls are bound to their Node::functions or Builtin::natives index.
+	struct Resolver {
+	    // A function or `ploop` body frame.
+	    struct Scope {
+		std::unordered_map<std::string, int32_t> locals;
+		NodeLoop*                                loop = nullptr;
+		std::vector<Capture>                     captures;
+	    };
+
+	    ErrorManager*                            error_manager;
+	    std::unordered_map<std::string, int32_t> globals;
+	    std::vector<Scope>                       scopes; // innermost last
+	    std::unordered_map<std::string, int32_t> functions;
+	    Node*                                    program = nullptr;
+	    NodeFunction*                            current = nullptr;
+	    std::vector<NodeBin*>                    spine;
+
+	    Resolver(ErrorManager* em) : error_manager(em) {}
+	    void resolve(Node& program);
+	    void resolve_function(NodeFunction* fn);
+	    void resolve_body(NodeBody* body);
+	    void resolve_stmt(NodeStmt* stmt);
+	    void resolve_expr(NodeExpr* expr);
+	    void resolve_parallel(NodeLoop* loop);
+	    int32_t lookup_local(size_t scope, const std::string& name);
+	};
+    } // namespace Language
+} // namespace Tisp
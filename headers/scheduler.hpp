@@ -0,0 +1,57 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Tisp {
+    namespace Runtime {
+	// Work-stealing thread pool for `ploop`. A run covers tasks [0, count).
+	// Each worker starts with an even, contiguous share. It takes tasks
+	// from the front of its own range. When that range is empty it steals
+	// the back half of another worker's range. Ranges only shrink during a
+	// run, so a worker that finds every range empty is done.
+	struct Scheduler {
+	    using Task = std::function<void(size_t task, size_t worker)>;
+
+	    struct Range {
+		std::mutex lock;
+		size_t     begin = 0;
+		size_t     end   = 0;
+	    };
+
+	    size_t                   workers;
+	    std::unique_ptr<Range[]> ranges;
+	    std::vector<std::thread> threads; // workers 1..n-1; the caller is worker 0
+	    std::mutex               lock;
+	    std::condition_variable  wake;
+	    std::condition_variable  done;
+	    const Task*              task       = nullptr;
+	    uint64_t                 generation = 0;
+	    size_t                   busy       = 0; // helper threads still in the current run
+	    bool                     stopping   = false;
+
+	    explicit Scheduler(size_t workers);
+	    ~Scheduler();
+	    Scheduler(const Scheduler&) = delete;
+	    Scheduler& operator=(const Scheduler&) = delete;
+
+	    // Calls `fn` once for every task and returns when all are done. One
+	    // run at a time; the calling thread works as worker 0.
+	    void run(size_t count, const Task& fn);
+
+	    // $TISP_THREADS, or the number of hardware threads.
+	    static size_t default_workers();
+
+	  private:
+	    void work(size_t worker);
+	    bool steal(size_t worker);
+	    void helper(size_t worker);
+	};
+    } // namespace Runtime
+} // namespace Tisp
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Tisp {
+    // Read-only view of a script file. Regular files are mmapped; anything
+    // that cannot be mapped (pipes, empty files) is read once into a heap
+    // buffer. The contents never move, so tokens can point straight into them.
+    struct SourceBuffer {
+	const char* data   = nullptr;
+	size_t      size   = 0;
+	bool        mapped = false;
+
+	SourceBuffer() = default;
+	SourceBuffer(const SourceBuffer&) = delete;
+	SourceBuffer& operator=(const SourceBuffer&) = delete;
+	SourceBuffer(SourceBuffer&& o) : data(o.data), size(o.size), mapped(o.mapped) {
+	    o.data   = nullptr;
+	    o.size   = 0;
+	    o.mapped = false;
+	}
+	SourceBuffer& operator=(SourceBuffer&& o);
+	~SourceBuffer() { release(); }
+
+	bool open(const std::string& path);
+	void copy_from(std::string_view text);
+	void release();
+	std::string_view view() const { return std::string_view(data ? data : "", size); }
+    };
+
+    struct SourceFile {
+	std::string           name;
+	SourceBuffer          buffer;
+	// Offset of the first byte of every line; built on the first diagnostic.
+	std::vector<uint32_t> line_starts;
+    };
+
+    struct SourceLocation {
+	std::string_view file;
+	std::string_view text;   // the whole line, without the newline
+	int              line;   // 1-based
+	int              column; // 1-based
+    };
+
+    // Owns every loaded script and its name once. Spans refer to files by the
+    // id returned from load() and line/column are only computed on demand.
+    struct SourceManager {
+	std::vector<std::unique_ptr<SourceFile>> files;
+
+	// Returns the new file id, or -1 if the file cannot be read.
+	int load(const std::string& path);
+	// Registers in-memory source text under `name`; the text is copied once.
+	int add(const std::string& name, std::string_view text);
+	std::string_view text(uint16_t file) const { return files[file]->buffer.view(); }
+	std::string_view name(uint16_t file) const { return files[file]->name; }
+	SourceLocation locate(uint16_t file, uint32_t offset);
+    };
+} // namespace Tisp
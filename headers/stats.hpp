@@ -0,0 +1,40 @@
+#pragma once
+
+#include <bytecode.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <parser.hpp>
+
+// Counters behind --stats. Builds without TISP_STATS (make STATS=0) compile
+// every TISP_STAT() away; --stats then only reports memory use.
+#if TISP_STATS
+#define TISP_STAT(...) __VA_ARGS__
+#else
+#define TISP_STAT(...)
+#endif
+
+namespace Tisp {
+    namespace Runtime {
+	struct NativeStats {
+	    uint64_t calls = 0;
+	    uint64_t ns    = 0;
+	};
+
+	struct Stats {
+	    static constexpr size_t max_natives = 16;
+
+	    // Set by --stats. Instruction counts and native timings are only
+	    // taken when enabled; the cheaper counters always run.
+	    bool        enabled = false;
+	    uint64_t    exprs[size_t(Language::ExprKind::Nop) + 1] = {}; // tree-walker evaluations by node type
+	    uint64_t    ops[size_t(OpCode::Halt) + 1]             = {}; // interpreted instructions by opcode
+	    // Variable reads, and those that found a slot still nil. Names are
+	    // resolved to slots, so an unassigned slot is the only way to miss.
+	    uint64_t    lookups = 0;
+	    uint64_t    misses  = 0;
+	    NativeStats natives[max_natives];
+
+	    void merge(const Stats& o);
+	};
+    } // namespace Runtime
+} // namespace Tisp
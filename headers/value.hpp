@@ -1,15 +1,20 @@
 #pragma once
 
+#include <atomic>
+#include <bit>
 #include <cstdint>
-#include <memory>
+#include <cstring>
+#include <functional>
+#include <span>
 #include <string>
-#include <variant>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
-#include <functional>
 
 namespace Tisp {
     namespace Value {
 	enum class ValueKind {
+	    Nil,
 	    Number,
 	    String,
 	    Object,
@@ -17,71 +22,224 @@ namespace Tisp {
 	    Error,
 	};
 
-	struct Value;
+	enum class ObjKind : uint8_t {
+	    Int,
+	    String,
+	    Error,
+	};
 
-	using ValuePtr = std::shared_ptr<Value>;
-	using Args = std::vector<ValuePtr>;
-	typedef std::variant<std::string, int64_t, std::pair<const char *, ValuePtr>>
-	ValueData;
+	struct Obj;
+	struct ObjInt;
+	struct ObjString;
 
+	// A NaN-boxed 64-bit value. Doubles are stored as themselves (reserved for
+	// floats), everything else lives in the quiet-NaN space:
+	//
+	//   QNAN | TAG_SPECIAL | payload   nil / false / true
+	//   QNAN | TAG_INT     | int48     integers in [-2^47, 2^47)
+	//   QNAN | TAG_STR     | chars     strings of up to 6 bytes, NUL padded
+	//   SIGN | QNAN        | pointer   heap objects
+	//
+	// Integers outside the inline range are boxed in an ObjInt, so arithmetic
+	// keeps full int64 semantics while the common case never allocates.
+	// Longer strings are ObjStrings; see Heap::make_string and Heap::intern.
 	struct Value {
-	    ValueKind kind;
-	    ValueData data;
-	    Value(ValuePtr p) : kind(p->kind), data(std::move(p->data)) {}
-	    Value(ValueKind k, ValueData d) : kind(k), data(std::move(d)) {}
-	    static ValuePtr obj_from_Value(const char *name, ValuePtr value) {
-		return std::make_shared<Value>(
-		Value(ValueKind::Object, std::pair(name, std::move(value))));
+	    static constexpr uint64_t SIGN        = 0x8000000000000000ull;
+	    static constexpr uint64_t QNAN        = 0x7ffc000000000000ull;
+	    static constexpr uint64_t TAG_MASK    = 0x0003000000000000ull;
+	    static constexpr uint64_t TAG_SPECIAL = 0x0000000000000000ull;
+	    static constexpr uint64_t TAG_INT     = 0x0001000000000000ull;
+	    static constexpr uint64_t TAG_STR     = 0x0002000000000000ull;
+	    static constexpr size_t   STR_MAX    = 6;
+	    static constexpr uint64_t PAYLOAD     = 0x0000ffffffffffffull;
+	    static constexpr int64_t  INT_MIN48   = -(int64_t(1) << 47);
+	    static constexpr int64_t  INT_MAX48   = (int64_t(1) << 47) - 1;
+
+	    uint64_t bits = QNAN | TAG_SPECIAL;
+
+	    static Value from_bits(uint64_t b) {
+		Value v;
+		v.bits = b;
+		return v;
+	    }
+	    static Value nil() { return Value(); }
+	    static bool fits_inline(int64_t n) { return n >= INT_MIN48 && n <= INT_MAX48; }
+	    // Caller guarantees fits_inline(n); use Heap::make_int otherwise.
+	    static Value small_int(int64_t n) {
+		return from_bits(QNAN | TAG_INT | (uint64_t(n) & PAYLOAD));
 	    }
-	    
-	    static ValuePtr make_error(std::string error_message) {
-		return std::make_shared<Value>(ValueKind::Error, std::move(error_message));
+	    static bool fits_small_str(std::string_view s) {
+		return s.size() <= STR_MAX && memchr(s.data(), 0, s.size()) == nullptr;
 	    }
-	    
-	    static ValuePtr make_string(std::string value) {
-		return std::make_shared<Value>(ValueKind::String, std::move(value));
+	    // Caller guarantees fits_small_str(s).
+	    static Value small_str(std::string_view s) {
+		uint64_t chars = 0;
+		memcpy(&chars, s.data(), s.size());
+		return from_bits(QNAN | TAG_STR | chars);
 	    }
-	    
-	    static ValuePtr make_int(int64_t number) {
-		return std::make_shared<Value>(ValueKind::Number, number);
+	    static Value from_obj(Obj* o) {
+		return from_bits(SIGN | QNAN | reinterpret_cast<uint64_t>(o));
 	    }
 
-	    bool is_truthy() {
-		if (kind == ValueKind::Number) {
-		    return (std::get<int64_t>(data) > 0);
-		}
-		if (kind == ValueKind::Object) {
-		    return std::get<std::pair<const char*, ValuePtr>>(data).second->is_truthy();
-		}
-		return false;
+	    bool is_nil() const { return bits == (QNAN | TAG_SPECIAL); }
+	    bool is_small_int() const { return (bits & (SIGN | QNAN | TAG_MASK)) == (QNAN | TAG_INT); }
+	    bool is_small_str() const { return (bits & (SIGN | QNAN | TAG_MASK)) == (QNAN | TAG_STR); }
+	    bool is_obj() const { return (bits & (SIGN | QNAN)) == (SIGN | QNAN); }
+	    int64_t small_int_value() const { return int64_t(bits << 16) >> 16; }
+	    Obj* as_obj() const { return reinterpret_cast<Obj*>(bits & PAYLOAD); }
+	    // Identity; see equals() for value equality.
+	    bool operator==(const Value& o) const { return bits == o.bits; }
+
+	    inline ValueKind kind() const;
+	    inline bool is_int() const;
+	    inline int64_t as_int() const;
+	    // Inline strings are viewed in place, so the view lives only as long
+	    // as this Value does; temporaries are rejected.
+	    inline std::string_view as_string() const&;
+	    std::string_view as_string() const&& = delete;
+	    // Strings and ints by value. Inline strings, and strings interned in
+	    // the same Heap, compare by bits alone; other heap strings compare
+	    // contents, since a `ploop` worker mixes strings from several heaps.
+	    bool equals(Value other) const;
+	    uint64_t hash() const;
+	    bool is_truthy() const;
+	    bool is_falsy() const;
+	    std::string to_string() const;
+	};
+
+	// Arguments to a native function: a view over the caller's value stack.
+	using Args = std::span<const Value>;
+
+	struct Obj {
+	    ObjKind kind;
+	    bool    marked = false;
+	    Obj*    next = nullptr;
+	    Obj(ObjKind k) : kind(k) {}
+	};
+
+	struct ObjInt : Obj {
+	    int64_t value;
+	    ObjInt(int64_t v) : Obj(ObjKind::Int), value(v) {}
+	};
+
+	// Immutable once created; the hash is computed up front.
+	struct ObjString : Obj {
+	    std::string value;
+	    uint64_t    hash;
+	    uint32_t    interned = 0; // Heap::id of the table holding it, or 0
+	    ObjString(ObjKind k, std::string v)
+	    : Obj(k), value(std::move(v)), hash(std::hash<std::string_view>()(value)) {}
+	};
+
+	struct GcStats {
+	    size_t collections   = 0;
+	    size_t freed_objects = 0;
+	    size_t freed_bytes   = 0;
+	    size_t peak_bytes    = 0;
+	    double pause_ms      = 0;
+	    size_t allocations[3] = {}; // by ObjKind, with TISP_STATS
+	};
+
+	// Owns every heap object a Vm (or a Chunk's constant pool) creates.
+	// The Vm's heap is collected by mark-sweep: the owner marks its roots
+	// with mark() and then calls sweep(), which frees everything unmarked.
+	// A Chunk's heap is never swept, so constants live as long as the chunk.
+	struct Heap {
+	    static constexpr size_t min_threshold = 1 << 20;
+
+	    Obj*    objects         = nullptr;
+	    size_t  bytes_allocated = 0;
+	    size_t  next_gc         = min_threshold;
+	    GcStats stats;
+	    // Interned strings by content; weak, entries go when sweep frees them.
+	    std::unordered_map<std::string_view, ObjString*> strings;
+	    // Tags the strings interned here. Unique per table, and kept by a
+	    // move, which hands the table over.
+	    uint32_t id = new_id();
+
+	    Heap() = default;
+	    Heap(const Heap&) = delete;
+	    Heap& operator=(const Heap&) = delete;
+	    Heap(Heap&& o)
+	    : objects(o.objects), bytes_allocated(o.bytes_allocated), next_gc(o.next_gc), stats(o.stats),
+	      strings(std::move(o.strings)), id(o.id) {
+		o.objects = nullptr;
+		o.bytes_allocated = 0;
+		o.id      = new_id();
+	    }
+	    ~Heap();
+
+	    template <typename T, typename... A>
+	    T* allocate(A&&... args) {
+		T* o = new T(std::forward<A>(args)...);
+		o->next = objects;
+		objects = o;
+		bytes_allocated += object_size(o);
+		if (bytes_allocated > stats.peak_bytes) stats.peak_bytes = bytes_allocated;
+#if TISP_STATS
+		stats.allocations[size_t(o->kind)]++;
+#endif
+		return o;
+	    }
+
+	    // True once enough has been allocated since the last sweep that the
+	    // owner should collect at its next safe point.
+	    bool should_collect() const {
+		return bytes_allocated >= next_gc;
+	    }
+	    static void mark(Value value) {
+		if (value.is_obj()) value.as_obj()->marked = true;
+	    }
+	    void sweep();
+	    static size_t object_size(const Obj* o);
+	    static uint32_t new_id() {
+		static std::atomic<uint32_t> next{1};
+		return next.fetch_add(1, std::memory_order_relaxed);
 	    }
-	    
-	    bool is_falsy() {
-		if (kind == ValueKind::Number) {
-		    return (std::get<int64_t>(data) < 0);
-		} if (kind == ValueKind::Object) {
-		    return std::get<std::pair<const char*, ValuePtr>>(data).second->is_falsy();
-		}
-		return false;
-	    } 
-	    
-	    std::string to_string() {
-		std::string repr;
-		if (kind == ValueKind::String) {
-		    
-		    repr = std::get<std::string>(data);
-		    
-		} else if (kind == ValueKind::Number) {
-
-		    repr = std::to_string(std::get<int64_t>(data));
-		    
-		} else if (kind == ValueKind::Object) {
-
-		    repr = std::get<std::pair<const char*, ValuePtr>>(data).second->to_string();
-		    
-		}
-		return repr;
+
+	    Value make_int(int64_t number) {
+		if (Value::fits_inline(number)) return Value::small_int(number);
+		return Value::from_obj(allocate<ObjInt>(number));
+	    }
+	    Value make_string(std::string value) {
+		if (Value::fits_small_str(value)) return Value::small_str(value);
+		return Value::from_obj(allocate<ObjString>(ObjKind::String, std::move(value)));
+	    }
+	    // One shared object per distinct string in this heap.
+	    Value intern(std::string_view value);
+	    Value make_error(std::string error_message) {
+		return Value::from_obj(allocate<ObjString>(ObjKind::Error, std::move(error_message)));
 	    }
 	};
+
+	inline ValueKind Value::kind() const {
+	    if (is_small_int()) return ValueKind::Number;
+	    if (is_small_str()) return ValueKind::String;
+	    if (!is_obj()) return ValueKind::Nil;
+	    switch (as_obj()->kind) {
+	    case ObjKind::Int:     return ValueKind::Number;
+	    case ObjKind::String:  return ValueKind::String;
+	    case ObjKind::Error:   return ValueKind::Error;
+	    }
+	    return ValueKind::Nil;
+	}
+
+	inline bool Value::is_int() const {
+	    return is_small_int() || (is_obj() && as_obj()->kind == ObjKind::Int);
+	}
+
+	inline int64_t Value::as_int() const {
+	    if (is_small_int()) return small_int_value();
+	    return static_cast<ObjInt*>(as_obj())->value;
+	}
+
+	inline std::string_view Value::as_string() const& {
+	    static_assert(std::endian::native == std::endian::little, "inline strings assume little-endian payload bytes");
+	    if (is_small_str()) {
+		const char* chars = reinterpret_cast<const char*>(&bits);
+		return std::string_view(chars, strnlen(chars, STR_MAX));
+	    }
+	    return static_cast<ObjString*>(as_obj())->value;
+	}
     } // namespace Value
 } // namespace Tisp
@@ -1,7 +1,14 @@
 #pragma once
 
+#include <bytecode.hpp>
+#include <jit.hpp>
 #include <memory>
+#include <output.hpp>
 #include <parser.hpp>
+#include <process.hpp>
+#include <profiler.hpp>
+#include <scheduler.hpp>
+#include <stats.hpp>
 #include <unordered_map>
 #include <value.hpp>
 
@@ -9,32 +16,119 @@ using namespace Tisp::Language;
 
 namespace Tisp {
     namespace Runtime {	
+	// Flat frame of `let` slots, numbered by the Resolver.
 	struct Env {
-	    using namespace::Value;
-	    std::unordered_map<std::string, std::shared_ptr<Value::Value>> variables;
-	    void set(std::string name, ValuePtr value) {
-		variables[name] = value;
+	    std::vector<Value::Value> slots;
+	    void set(uint32_t slot, Value::Value value) {
+		slots[slot] = value;
 	    }
-	    ValuePtr get(std::string name) {
-		if (variables.count(name) == 0) {
-		    return Value::make_error("Variable Not Declared");
-		}
+	    Value::Value get(uint32_t slot) {
+		return slots[slot];
 	    }
 	};
 	
+	// Saved caller state for a user function call. Locals live on the value
+	// stack from `bp` up, so a call allocates nothing of its own. The
+	// tree-walker has no return address; it keeps the callee's index in
+	// `return_ip` and the call's span in `site`, for the profiler.
+	struct Frame {
+	    size_t return_ip;
+	    size_t bp;
+	    Span   site = {};
+	};
+
+	struct ParallelWorker;
+
+	// The body of a `ploop`: bytecode from `entry` in `chunk`, or the
+	// tree-walker's NodeLoop.
+	struct LoopBody {
+	    Chunk*    chunk = nullptr;
+	    size_t    entry = 0;
+	    NodeLoop* loop  = nullptr;
+	};
+
 	struct Vm {
-	    using NativeFn = std::function<Value::ValuePtr(Vm* vm, Value::Args args)>;
+	    static constexpr size_t max_frames = 1 << 20;
+	    // The tree-walker recurses on the native stack for non-tail calls.
+	    static constexpr size_t max_tree_frames = 1 << 13;
+
 	    ErrorManager*                              error_manager;
 	    Language::Node                             program;
 	    Env                                        env;
-	    std::unordered_map<std::string, NativeFn>  builtins;
-	    
+	    Value::Heap                                heap;
+	    Value::Heap                                literals; // never swept
+	    std::vector<Value::Value>                  stack;
+	    std::vector<Frame>                         frames;
+	    // Tree-walker state: the running function's frame base, and the
+	    // pending `return` (a tail call when `tail_call` is set).
+	    size_t                                     bp = 0;
+	    bool                                       returning = false;
+	    Value::Value                               return_value;
+	    NodeFunction*                              tail_call = nullptr;
+	    std::vector<Value::Value>                  tail_args;
+	    Output                                     out;
+	    ProcessTable                               processes;
+	    Jit                                        jit;
+	    std::vector<NodeBin*>                      spine;
+	    // `ploop` state. The pool and its per-thread Vms are made on first
+	    // use; a worker Vm runs any nested `ploop` inline. `pinned` holds the
+	    // frame templates of running loops, which are GC roots.
+	    bool                                         worker = false;
+	    std::unique_ptr<Scheduler>                   scheduler;
+	    std::vector<std::unique_ptr<ParallelWorker>> workers;
+	    std::vector<Value::Value>                    pinned;
+	    // Set for --profile; shared with the `ploop` workers.
+	    Profiler*                                    profiler = nullptr;
+	    Stats                                        stats;
+	    // The native call running, where it reports bad arguments.
+	    Span                                         native_site;
+
 	    Vm(Language::Node program, ErrorManager* em);
 	    void execute();
+	    // Runs from `entry` until Halt, with `base` as the frame base.
+	    void run(Chunk& chunk, size_t entry = 0, size_t base = 0);
 	    void execute_node(NodeStmt* node);
-	    Value::ValuePtr generate_value(NodeExpr* expr);
-	    Value::ValuePtr handle_call(NodeCall *call);
-	    Value::Args to_values(std::vector<Exprptr> &args);
+	    Value::Value generate_value(NodeExpr* expr);
+	    Value::Value binary_value(BinaryOp op, Value::Value lhs, Value::Value rhs, Span span);
+	    // Flushes output and reports a run-time error at `span`; fatal.
+	    void fail(Span span, const char* message);
+	    Value::Value handle_call(NodeCall *call);
+	    // Calls Builtin::natives[index], counting (and timing) it for --stats.
+	    // `site` is the call, where a native reports a bad argument.
+	    Value::Value call_native(size_t index, Value::Args args, Span site);
+	    Value::Value call_function(NodeFunction* fn, size_t base, Span span);
+	    void execute_body(NodeBody* body);
+	    // Marks env, stack and process values and sweeps the heap. Only
+	    // called at safe points, where no live value is held outside those.
+	    void collect_garbage();
+	    // Takes the profiler's pending ticks, charging them to the call
+	    // stack at `ip` in `chunk` (or at `span` in the tree-walker).
+	    void sample(const Chunk& chunk, size_t ip);
+	    void sample(Span span);
+	    // Runs iterations [0, times) of a `ploop` body, each on a copy of
+	    // `frame` with the index in slot 0. Output is written in iteration
+	    // order and the first failing iteration's error is reported.
+	    void parallel_loop(LoopBody body, int64_t times, const std::vector<Value::Value>& frame);
+	    void run_iterations(LoopBody body, int64_t begin, int64_t end, const std::vector<Value::Value>& frame);
+	    // Copy of `value` whose heap objects, if any, belong to this Vm.
+	    Value::Value import_value(Value::Value value);
+	    // --stats report for this Vm and its `ploop` workers, as text or
+	    // as one JSON object.
+	    void write_stats(std::ostream& out, bool json);
+	};
+
+	// A scheduler thread's Vm and its private copy of the running chunk,
+	// kept from one `ploop` to the next.
+	struct ParallelWorker {
+	    ErrorManager              errors;
+	    std::unique_ptr<Vm>       vm;
+	    std::unique_ptr<Chunk>    chunk;
+	    const Chunk*              forked_from = nullptr;
+	    std::vector<Value::Value> frame;
+
+	    ParallelWorker(Tisp::SourceManager* sources) : errors(sources) {
+		errors.throw_errors = true;
+	    }
 	};
     } // namespace Runtime
 } // namespace Tisp
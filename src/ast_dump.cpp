@@ -0,0 +1,149 @@
+#include <ast_dump.hpp>
+#include <string>
+
+namespace Tisp {
+    namespace Language {
+	static const char* binary_name(BinaryOp op) {
+	    switch (op) {
+	    case BinaryOp::Add:  return "+";
+	    case BinaryOp::Sub:  return "-";
+	    case BinaryOp::Mul:  return "*";
+	    case BinaryOp::Div:  return "/";
+	    case BinaryOp::Mod:  return "%";
+	    case BinaryOp::Shl:  return "<<";
+	    case BinaryOp::Shr:  return ">>";
+	    case BinaryOp::And:  return "&&";
+	    case BinaryOp::Or:   return "||";
+	    case BinaryOp::Band: return "&";
+	    case BinaryOp::Bor:  return "|";
+	    case BinaryOp::Lt:   return "<";
+	    case BinaryOp::Le:   return "<=";
+	    case BinaryOp::Gt:   return ">";
+	    case BinaryOp::Ge:   return ">=";
+	    case BinaryOp::Eq:   return "==";
+	    case BinaryOp::Ne:   return "!=";
+	    }
+	    return "?";
+	}
+
+	static void dump_body(const char* tag, NodeBody* body, std::ostream& out, int depth);
+
+	static void dump_expr(NodeExpr* expr, std::ostream& out, int depth) {
+	    std::string pad(depth * 2, ' ');
+	    switch (expr->kind) {
+	    case ExprKind::Int:
+		out << pad << "(int " << static_cast<NodeInt*>(expr)->value << ")\n";
+		break;
+	    case ExprKind::String:
+		out << pad << "(string \"" << static_cast<NodeString*>(expr)->value << "\")\n";
+		break;
+	    case ExprKind::Ident: {
+		auto nid = static_cast<NodeIdent*>(expr);
+		out << pad << "(ident " << nid->identifier;
+		if (nid->slot >= 0) out << "#" << nid->slot;
+		out << ")\n";
+	    } break;
+	    case ExprKind::Bin: {
+		auto nbin = static_cast<NodeBin*>(expr);
+		out << pad << "(" << binary_name(nbin->op) << "\n";
+		dump_expr(nbin->lhs, out, depth + 1);
+		dump_expr(nbin->rhs, out, depth + 1);
+		out << pad << ")\n";
+	    } break;
+	    case ExprKind::Call: {
+		auto ncall = static_cast<NodeCall*>(expr);
+		out << pad << "(call\n";
+		dump_expr(ncall->callee, out, depth + 1);
+		for (auto arg : ncall->args) {
+		    dump_expr(arg, out, depth + 1);
+		}
+		out << pad << ")\n";
+	    } break;
+	    case ExprKind::If: {
+		auto nif = static_cast<NodeIf*>(expr);
+		out << pad << "(if\n";
+		dump_expr(nif->condition, out, depth + 1);
+		dump_body("then", nif->then_body, out, depth + 1);
+		if (nif->else_body) {
+		    dump_body("else", nif->else_body, out, depth + 1);
+		}
+		out << pad << ")\n";
+	    } break;
+	    case ExprKind::Loop: {
+		auto nloop = static_cast<NodeLoop*>(expr);
+		if (nloop->parallel) {
+		    out << pad << "(ploop" << (nloop->index ? std::string(" ") + nloop->index : "") << " frame=" << nloop->frame_size;
+		    for (auto capture : nloop->captures) {
+			out << " " << capture.outer << "->" << capture.inner;
+		    }
+		    out << "\n";
+		} else {
+		    out << pad << "(loop\n";
+		}
+		dump_expr(nloop->times, out, depth + 1);
+		dump_body("body", nloop->body, out, depth + 1);
+		out << pad << ")\n";
+	    } break;
+	    case ExprKind::Block: {
+		auto nblock = static_cast<NodeBlock*>(expr);
+		out << pad << "(block\n";
+		dump_body("body", nblock->body, out, depth + 1);
+		dump_expr(nblock->value, out, depth + 1);
+		out << pad << ")\n";
+	    } break;
+	    case ExprKind::Nop:
+		out << pad << "(nop)\n";
+		break;
+	    }
+	}
+
+	static void dump_stmt(NodeStmt* stmt, std::ostream& out, int depth) {
+	    std::string pad(depth * 2, ' ');
+	    switch (stmt->kind) {
+	    case StmtKind::Assignment: {
+		auto node = std::get<NodeAssignment*>(stmt->stmt);
+		out << pad << "(let " << node->name << "#" << node->slot << "\n";
+		dump_expr(node->expr, out, depth + 1);
+		out << pad << ")\n";
+	    } break;
+	    case StmtKind::Expr:
+		dump_expr(std::get<NodeExprStmt*>(stmt->stmt)->expr, out, depth);
+		break;
+	    case StmtKind::Function: {
+		auto fn = std::get<NodeFunction*>(stmt->stmt);
+		out << pad << "(func " << fn->name;
+		for (auto param : fn->params) {
+		    out << " " << param;
+		}
+		out << "\n";
+		dump_body("body", fn->body, out, depth + 1);
+		out << pad << ")\n";
+	    } break;
+	    case StmtKind::Return: {
+		auto node = std::get<NodeReturn*>(stmt->stmt);
+		out << pad << "(return\n";
+		if (node->value) {
+		    dump_expr(node->value, out, depth + 1);
+		}
+		out << pad << ")\n";
+	    } break;
+	    default:
+		out << pad << "(nop)\n";
+		break;
+	    }
+	}
+
+	static void dump_body(const char* tag, NodeBody* body, std::ostream& out, int depth) {
+	    std::string pad(depth * 2, ' ');
+	    out << pad << "(" << tag << "\n";
+	    for (auto stmt : body->stmts) {
+		dump_stmt(stmt, out, depth + 1);
+	    }
+	    out << pad << ")\n";
+	}
+
+	void dump_ast(const Node& program, std::ostream& out) {
+	    dump_body("program", std::get<NodeBody*>(program.stmt->stmt), out, 0);
+	}
+    } // namespace Language
+} // namespace Tisp
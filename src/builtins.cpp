@@ -2,27 +2,143 @@
 #include <builtins.hpp>
 #include <cstdint>
 #include <cstdio>
-#include <iostream>
-#include <assert.h>
+#include <unistd.h>
+#include <utility>
 namespace Tisp::Runtime::Builtin {
-    Value::ValuePtr println(Vm *vm, std::vector<Value::ValuePtr> args) {
-	print(vm, args);
-	std::cout << "\n";
-	return Value::Value::make_int(0);
-    }
-    Value::ValuePtr exec(Vm *vm, std::vector<Value::ValuePtr> args) {
-	assert(args.size() == 1);
-	auto arg = args.at(0);
-	assert(arg->kind == Value::ValueKind::String);
+    // Writes each argument followed by a space into the VM's output buffer.
+    static void write_args(Vm *vm, Value::Args args) {
+	for (auto arg : args) {
+	    vm->out.write_value(arg);
+	    vm->out.write(" ");
+	}
+    }
+    Value::Value println(Vm *vm, Value::Args args) {
+	write_args(vm, args);
+	vm->out.write("\n");
+	vm->out.end_print(true);
+	return Value::Value::small_int(0);
+    }
+    // Reports a misused native at its call site; with throw_errors set
+    // (Engine) that throws DiagnosticError.
+    static void require(Vm *vm, bool ok, const char* message) {
+	if (!ok) {
+	    vm->fail(vm->native_site, message);
+	}
+    }
+    Value::Value exec(Vm *vm, Value::Args args) {
+	require(vm, args.size() == 1 && args[0].kind() == Value::ValueKind::String, "exec expects one command string");
+	auto arg = args[0];
 
-	auto cmd = arg->to_string();
-	// Run Command and return the return value of the command
-	return Value::Value::make_int(system(cmd.c_str()));
+	auto cmd = arg.to_string();
+	// The child shares our stdout; keep the output in order.
+	vm->out.flush();
+	// Run the command through the shell and return its exit code. When
+	// output goes to a sink (an Isolate) the child's stdout goes there too.
+	bool     capture = vm->out.sink != nullptr;
+	int      handle  = vm->processes.spawn({"/bin/sh", "-c", cmd}, capture);
+	int      status  = vm->processes.wait(handle);
+	Process& proc    = vm->processes.procs[handle];
+	if (capture) {
+	    vm->out.write(proc.out);
+	    if (!proc.err.empty()) {
+		::write(2, proc.err.data(), proc.err.size());
+	    }
+	}
+	vm->processes.release(handle);
+	return vm->heap.make_int(status);
+    }
+
+    // spawn("prog arg ...") or spawn("prog", arg, ...): argv for a child.
+    static std::vector<std::string> command_argv(Value::Args args) {
+	if (args.size() == 1) {
+	    return split_command(args[0].as_string());
+	}
+	std::vector<std::string> argv;
+	for (auto arg : args) {
+	    argv.push_back(arg.to_string());
+	}
+	return argv;
     }
-    Value::ValuePtr print(Vm *vm, std::vector<Value::ValuePtr> args) {
-	for(auto arg: args) {
-	    std::cout << arg->to_string() << " ";
+    static Process& process_arg(Vm *vm, Value::Args args) {
+	require(vm, args.size() == 1 && args[0].is_int() && vm->processes.valid(args[0].as_int()),
+		"Expected a process handle from spawn");
+	return vm->processes.procs[args[0].as_int()];
+    }
+    Value::Value spawn(Vm *vm, Value::Args args) {
+	require(vm, args.size() >= 1 && args[0].kind() == Value::ValueKind::String, "spawn expects a command string");
+	int handle = vm->processes.spawn(command_argv(args), true);
+	// Give already-running children a chance to empty their pipes.
+	vm->processes.pump(0);
+	return vm->heap.make_int(handle);
+    }
+    Value::Value wait(Vm *vm, Value::Args args) {
+	process_arg(vm, args);
+	return vm->heap.make_int(vm->processes.wait(args[0].as_int()));
+    }
+    Value::Value stdout_of(Vm *vm, Value::Args args) {
+	Process& proc = process_arg(vm, args);
+	vm->processes.wait(args[0].as_int());
+	if (proc.out_value.is_nil()) {
+	    // Exchanged, so the table keeps no copy of the text.
+	    proc.out_value = vm->heap.make_string(std::exchange(proc.out, {}));
+	}
+	return proc.out_value;
+    }
+    Value::Value stderr_of(Vm *vm, Value::Args args) {
+	Process& proc = process_arg(vm, args);
+	vm->processes.wait(args[0].as_int());
+	if (proc.err_value.is_nil()) {
+	    proc.err_value = vm->heap.make_string(std::exchange(proc.err, {}));
 	}
-	return Value::Value::make_int(0);
+	return proc.err_value;
+    }
+    Value::Value exec_all(Vm *vm, Value::Args args) {
+	require(vm, args.size() >= 1 && args[0].is_int(), "exec_all expects a job limit, then command strings");
+	// Checked up front, so a bad argument doesn't leave commands half run.
+	for (size_t i = 1; i < args.size(); i++) {
+	    require(vm, args[i].kind() == Value::ValueKind::String, "exec_all expects a job limit, then command strings");
+	}
+	size_t limit = args[0].as_int() > 0 ? args[0].as_int() : 1;
+	auto&  table = vm->processes;
+	vm->out.flush();
+
+	std::vector<int> handles;
+	size_t           next    = 1; // next command argument to start
+	size_t           emitted = 0; // handles whose output has been written
+	int64_t          failed  = 0;
+	auto running = [&]() {
+	    size_t n = 0;
+	    for (size_t i = emitted; i < handles.size(); i++) {
+		n += !table.procs[handles[i]].exited;
+	    }
+	    return n;
+	};
+	while (next < args.size() || emitted < handles.size()) {
+	    while (next < args.size() && running() < limit) {
+		handles.push_back(table.spawn(split_command(args[next].as_string()), true));
+		next++;
+	    }
+	    if (running() > 0) {
+		table.pump(-1);
+	    }
+	    // Write output in command order, as soon as each prefix is done.
+	    while (emitted < handles.size() && table.procs[handles[emitted]].exited) {
+		Process& proc = table.procs[handles[emitted]];
+		vm->out.write(proc.out);
+		vm->out.flush();
+		if (!proc.err.empty()) {
+		    ::write(2, proc.err.data(), proc.err.size());
+		}
+		failed += proc.status != 0;
+		table.release(handles[emitted]);
+		emitted++;
+	    }
+	}
+	return vm->heap.make_int(failed);
+    }
+    Value::Value print(Vm *vm, Value::Args args) {
+	write_args(vm, args);
+	vm->out.end_print(false);
+	return Value::Value::small_int(0);
     }
 } // namespace Tisp::Runtime::Builtin
@@ -0,0 +1,254 @@
+#include <cache.hpp>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace Tisp {
+    namespace Runtime {
+	namespace {
+	    constexpr char magic[4] = {'T', 'S', 'P', 'C'};
+	    // Bumped whenever the layout below changes.
+	    constexpr uint64_t format     = 2;
+	    constexpr uint64_t fnv_offset = 0xcbf29ce484222325ull;
+
+	    // Fixed-size part of a .tspc file. Sections follow in this order:
+	    // imports, code, spans, functions, constants, then the function
+	    // names. Each import is (u32 length, path, u64 hash of its text).
+	    // Spans are run-length encoded as (u32 count, Span), since every
+	    // byte of an instruction shares one; their file is 0 for the script
+	    // and i + 1 for its i-th import.
+	    struct CacheHeader {
+		char     magic[4];
+		uint32_t version;
+		uint64_t key;
+		uint32_t frame_size;
+		uint32_t import_count;
+		uint32_t code_size;
+		uint32_t function_count;
+		uint32_t constant_count;
+		uint32_t span_runs;
+	    };
+
+	    enum class ConstantKind : uint8_t {
+		Inline, // bits as they are: small ints and short strings
+		Int,    // int64 that doesn't fit inline
+		String, // u32 length, bytes; interned on load
+	    };
+
+	    uint64_t fnv1a(uint64_t hash, const void* data, size_t size) {
+		auto bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++) {
+		    hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+		}
+		return hash;
+	    }
+
+	    template <typename T>
+	    void put(std::string& out, const T& value) {
+		out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	    }
+
+	    // Bounds-checked cursor over the mapped file; any short read makes
+	    // the whole file a miss.
+	    struct Reader {
+		const char* at;
+		const char* end;
+		bool        ok = true;
+
+		const char* take(size_t n) {
+		    if (!ok || size_t(end - at) < n) {
+			ok = false;
+			return nullptr;
+		    }
+		    const char* p = at;
+		    at += n;
+		    return p;
+		}
+		template <typename T>
+		T get() {
+		    T value{};
+		    if (const char* p = take(sizeof(T))) memcpy(&value, p, sizeof(T));
+		    return value;
+		}
+	    };
+	}
+
+	ScriptCache::ScriptCache(const std::string& source_path, std::string_view source, bool optimized) {
+	    uint64_t seed[] = {format, bytecode_version, uint64_t(OpCode::Halt), sizeof(Span), optimized};
+	    key = fnv1a(fnv_offset, seed, sizeof(seed));
+	    key = fnv1a(key, source.data(), source.size());
+	    if (const char* dir = getenv("TISP_CACHE_DIR")) {
+		// One file per script path, so different scripts don't evict each other.
+		char name[32];
+		snprintf(name, sizeof(name), "/%016llx.tspc",
+			 (unsigned long long)fnv1a(fnv_offset, source_path.data(), source_path.size()));
+		path = std::string(dir) + name;
+	    } else if (source_path.ends_with(".tsp")) {
+		path = source_path + "c";
+	    } else {
+		path = source_path + ".tspc";
+	    }
+	}
+
+	bool ScriptCache::load(SourceManager& sources, uint16_t file) {
+	    if (!mapping.open(path)) return false;
+	    Reader in{mapping.data, mapping.data + mapping.size};
+	    auto header = in.get<CacheHeader>();
+	    if (!in.ok || memcmp(header.magic, magic, 4) != 0 || header.version != bytecode_version || header.key != key) {
+		return false;
+	    }
+	    // Imports are checked first but only added to `sources` on a hit.
+	    std::vector<std::unique_ptr<SourceFile>> imports;
+	    for (uint32_t i = 0; i < header.import_count; i++) {
+		uint32_t    size = in.get<uint32_t>();
+		const char* name = in.take(size);
+		uint64_t    hash = in.get<uint64_t>();
+		if (!in.ok) return false;
+		auto source  = std::make_unique<SourceFile>();
+		source->name = std::string(name, size);
+		if (!source->buffer.open(source->name) || fnv1a(fnv_offset, source->buffer.data, source->buffer.size) != hash) {
+		    return false;
+		}
+		imports.push_back(std::move(source));
+	    }
+	    const char* code = in.take(header.code_size);
+	    if (!in.ok) return false;
+	    chunk.code.assign(code, code + header.code_size);
+	    chunk.spans.reserve(header.code_size);
+	    for (uint32_t i = 0; i < header.span_runs && in.ok; i++) {
+		uint32_t count = in.get<uint32_t>();
+		Span     span  = in.get<Span>();
+		if (span.file > imports.size() || count > header.code_size - chunk.spans.size()) return false;
+		chunk.spans.insert(chunk.spans.end(), count, span);
+	    }
+	    if (chunk.spans.size() != header.code_size) return false;
+	    std::vector<uint32_t> name_offsets;
+	    for (uint32_t i = 0; i < header.function_count; i++) {
+		FunctionInfo fn{};
+		fn.entry      = in.get<uint32_t>();
+		fn.frame_size = in.get<uint32_t>();
+		fn.arity      = in.get<uint16_t>();
+		name_offsets.push_back(in.get<uint32_t>());
+		chunk.functions.push_back(fn);
+	    }
+	    for (uint32_t i = 0; i < header.constant_count && in.ok; i++) {
+		switch (in.get<ConstantKind>()) {
+		case ConstantKind::Inline:
+		    chunk.constants.push_back(Value::Value::from_bits(in.get<uint64_t>()));
+		    break;
+		case ConstantKind::Int:
+		    chunk.constants.push_back(chunk.heap.make_int(in.get<int64_t>()));
+		    break;
+		case ConstantKind::String: {
+		    uint32_t    size = in.get<uint32_t>();
+		    const char* text = in.take(size);
+		    if (text) chunk.constants.push_back(chunk.heap.intern(std::string_view(text, size)));
+		} break;
+		default:
+		    in.ok = false;
+		}
+	    }
+	    // Names are NUL-terminated in the trailing blob and used in place.
+	    size_t names = in.at - mapping.data;
+	    for (size_t i = 0; i < name_offsets.size() && in.ok; i++) {
+		size_t at = names + name_offsets[i];
+		if (at >= mapping.size || !memchr(mapping.data + at, 0, mapping.size - at)) return false;
+		chunk.functions[i].name = mapping.data + at;
+	    }
+	    if (!in.ok) return false;
+	    std::vector<uint16_t> files = {file};
+	    for (auto& source : imports) {
+		files.push_back(sources.files.size());
+		sources.files.push_back(std::move(source));
+	    }
+	    for (auto& span : chunk.spans) {
+		span.file = files[span.file];
+	    }
+	    frame_size = header.frame_size;
+	    return true;
+	}
+
+	void ScriptCache::store(const Chunk& compiled, uint32_t globals, const SourceManager& sources, uint16_t file) const {
+	    std::string out;
+	    CacheHeader header;
+	    memcpy(header.magic, magic, 4);
+	    header.version        = bytecode_version;
+	    header.key            = key;
+	    header.frame_size     = globals;
+	    header.import_count   = sources.files.size() - 1;
+	    header.code_size      = compiled.code.size();
+	    header.function_count = compiled.functions.size();
+	    header.constant_count = compiled.constants.size();
+	    header.span_runs      = 0;
+	    put(out, header);
+	    std::vector<uint16_t> index(sources.files.size());
+	    for (size_t id = 0, next = 1; id < sources.files.size(); id++) {
+		if (id == file) continue;
+		std::string_view name = sources.name(id);
+		std::string_view text = sources.text(id);
+		index[id]             = next++;
+		put(out, uint32_t(name.size()));
+		out.append(name);
+		put(out, fnv1a(fnv_offset, text.data(), text.size()));
+	    }
+	    out.append(reinterpret_cast<const char*>(compiled.code.data()), compiled.code.size());
+	    for (size_t i = 0; i < compiled.spans.size();) {
+		const Span& span = compiled.spans[i];
+		size_t      end  = i + 1;
+		while (end < compiled.spans.size() && memcmp(&compiled.spans[end], &span, sizeof(Span)) == 0) {
+		    end++;
+		}
+		Span stored = span;
+		stored.file = index[span.file];
+		put(out, uint32_t(end - i));
+		put(out, stored);
+		header.span_runs++;
+		i = end;
+	    }
+	    std::string names;
+	    for (auto& fn : compiled.functions) {
+		put(out, fn.entry);
+		put(out, fn.frame_size);
+		put(out, fn.arity);
+		put(out, uint32_t(names.size()));
+		names.append(fn.name ? fn.name : "");
+		names.push_back('\0');
+	    }
+	    for (auto value : compiled.constants) {
+		if (!value.is_obj()) {
+		    put(out, ConstantKind::Inline);
+		    put(out, value.bits);
+		} else if (value.is_int()) {
+		    put(out, ConstantKind::Int);
+		    put(out, value.as_int());
+		} else {
+		    std::string_view text = value.as_string();
+		    put(out, ConstantKind::String);
+		    put(out, uint32_t(text.size()));
+		    out.append(text);
+		}
+	    }
+	    out.append(names);
+	    memcpy(out.data() + offsetof(CacheHeader, span_runs), &header.span_runs, sizeof(header.span_runs));
+
+	    // Write to a private name and rename, so a concurrent run never maps
+	    // a half-written file.
+	    std::string tmp = path + "." + std::to_string(getpid());
+	    int         fd  = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	    if (fd < 0) return;
+	    size_t done = 0;
+	    while (done < out.size()) {
+		ssize_t n = ::write(fd, out.data() + done, out.size() - done);
+		if (n <= 0) break;
+		done += n;
+	    }
+	    close(fd);
+	    if (done != out.size() || rename(tmp.c_str(), path.c_str()) != 0) {
+		unlink(tmp.c_str());
+	    }
+	}
+    } // namespace Runtime
+} // namespace Tisp
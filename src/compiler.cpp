@@ -0,0 +1,273 @@
+#include <cassert>
+#include <builtins.hpp>
+#include <compiler.hpp>
+#include <sstream>
+
+using namespace Tisp::Language;
+
+namespace Tisp {
+    namespace Runtime {
+	Chunk Compiler::compile(Node& program) {
+	    auto body = std::get<NodeBody*>(program.stmt->stmt);
+	    for (auto fn : program.functions) {
+		chunk.functions.push_back(FunctionInfo{0, fn->frame_size, uint16_t(fn->params.size()), fn->name});
+	    }
+	    compile_body(body);
+	    if (program.main >= 0) {
+		Span span = program.functions[program.main]->span;
+		chunk.emit_op(OpCode::Call, span);
+		emit_index(program.main, span, "functions");
+		chunk.emit(0, span);
+		chunk.emit_op(OpCode::Pop, span);
+	    }
+	    chunk.emit_op(OpCode::Halt, program.stmt->span);
+	    // Function bodies follow the top-level code; falling off the end
+	    // returns nil.
+	    for (auto fn : program.functions) {
+		chunk.functions[fn->index].entry = chunk.code.size();
+		compile_body(fn->body);
+		chunk.emit_op(OpCode::Nil, fn->span);
+		chunk.emit_op(OpCode::Return, fn->span);
+	    }
+	    // A `ploop` body is a function of its frame. The Halt in front of it
+	    // is where its Return lands, ending the Vm::run that ran the body.
+	    for (size_t i = 0; i < parallel_bodies.size(); i++) {
+		auto [nloop, index] = parallel_bodies[i];
+		chunk.emit_op(OpCode::Halt, nloop->span);
+		chunk.functions[index].entry = chunk.code.size();
+		compile_body(nloop->body);
+		chunk.emit_op(OpCode::Nil, nloop->span);
+		chunk.emit_op(OpCode::Return, nloop->span);
+	    }
+	    return std::move(chunk);
+	}
+
+	void Compiler::compile_body(NodeBody* body) {
+	    for (auto stmt : body->stmts) {
+		compile_stmt(stmt);
+	    }
+	}
+
+	void Compiler::compile_stmt(NodeStmt* n) {
+	    switch (n->kind) {
+	    case StmtKind::Assignment: {
+		NodeAssignment* node = std::get<NodeAssignment*>(n->stmt);
+		compile_expr(node->expr);
+		chunk.emit_op(node->global ? OpCode::SetGlobal : OpCode::SetLocal, node->span);
+		emit_index(node->slot, node->span, "variables");
+	    } break;
+	    case StmtKind::Return: {
+		auto node = std::get<NodeReturn*>(n->stmt);
+		if (node->value && node->value->kind == ExprKind::Call &&
+		    static_cast<NodeCall*>(node->value)->function >= 0) {
+		    // A call in return position reuses the current frame.
+		    auto ncall = static_cast<NodeCall*>(node->value);
+		    for (auto arg : ncall->args) {
+			compile_expr(arg);
+		    }
+		    chunk.emit_op(OpCode::TailCall, node->span);
+		    emit_index(ncall->function, node->span, "functions");
+		    chunk.emit(ncall->args.size(), node->span);
+		    break;
+		}
+		if (node->value) {
+		    compile_expr(node->value);
+		} else {
+		    chunk.emit_op(OpCode::Nil, node->span);
+		}
+		chunk.emit_op(OpCode::Return, node->span);
+	    } break;
+	    case StmtKind::Expr: {
+		auto expr = std::get<NodeExprStmt*>(n->stmt);
+		compile_expr(expr->expr);
+		chunk.emit_op(OpCode::Pop, n->span);
+	    } break;
+	    default:
+		break;
+	    }
+	}
+
+	void Compiler::compile_expr(NodeExpr* expr) {
+	    switch (expr->kind) {
+	    case ExprKind::Int: {
+		auto nint = static_cast<NodeInt*>(expr);
+		chunk.emit_op(OpCode::Const, expr->span);
+		emit_index(int_constant(nint->value), expr->span, "constants");
+	    } break;
+	    case ExprKind::String: {
+		auto nstr = static_cast<NodeString*>(expr);
+		chunk.emit_op(OpCode::Const, expr->span);
+		emit_index(string_constant(nstr->value), expr->span, "constants");
+	    } break;
+	    case ExprKind::Ident: {
+		auto nid = static_cast<NodeIdent*>(expr);
+		chunk.emit_op(nid->global ? OpCode::GetGlobal : OpCode::GetLocal, expr->span);
+		emit_index(nid->slot, expr->span, "variables");
+	    } break;
+	    case ExprKind::Bin: {
+		// Operator chains are left-deep; walk the left spine instead of recursing.
+		size_t    mark = spine.size();
+		NodeExpr* left = expr;
+		while (left->kind == ExprKind::Bin) {
+		    spine.push_back(static_cast<NodeBin*>(left));
+		    left = static_cast<NodeBin*>(left)->lhs;
+		}
+		compile_expr(left);
+		while (spine.size() > mark) {
+		    NodeBin* nbin = spine.back();
+		    spine.pop_back();
+		    if (nbin->op == BinaryOp::And || nbin->op == BinaryOp::Or) {
+			// Short-circuit: the right side only runs when the left doesn't decide.
+			size_t skip = emit_jump(nbin->op == BinaryOp::And ? OpCode::AndJump : OpCode::OrJump, nbin->span);
+			compile_expr(nbin->rhs);
+			chunk.emit_op(OpCode::ToBool, nbin->span);
+			patch_jump(skip);
+			continue;
+		    }
+		    compile_expr(nbin->rhs);
+		    chunk.emit_op(binary_opcode(nbin->op), nbin->span);
+		}
+	    } break;
+	    case ExprKind::Call: {
+		auto ncall = static_cast<NodeCall*>(expr);
+		if (ncall->callee->kind != ExprKind::Ident) {
+		    error_manager->report(Diagnostic(DiagnosticType::Error, expr->span, "Callee must be a name", ""), true);
+		}
+		if (ncall->function >= 0) {
+		    for (auto arg : ncall->args) {
+			compile_expr(arg);
+		    }
+		    chunk.emit_op(OpCode::Call, expr->span);
+		    emit_index(ncall->function, expr->span, "functions");
+		    chunk.emit(ncall->args.size(), expr->span);
+		    break;
+		}
+		// Resolve the callee once here so the VM calls through a table index.
+		int32_t native = Builtin::find_native(static_cast<NodeIdent*>(ncall->callee)->identifier);
+		if (native < 0) {
+		    error_manager->report(Diagnostic(DiagnosticType::Error, ncall->callee->span, "Unknown function", ""), true);
+		}
+		for (auto arg : ncall->args) {
+		    compile_expr(arg);
+		}
+		chunk.emit_op(OpCode::CallNative, expr->span);
+		chunk.emit_u16(native, expr->span);
+		chunk.emit(ncall->args.size(), expr->span);
+	    } break;
+	    case ExprKind::If: {
+		auto nif = static_cast<NodeIf*>(expr);
+		compile_expr(nif->condition);
+		size_t else_jump = emit_jump(OpCode::JumpIfFalse, expr->span);
+		compile_body(nif->then_body);
+		size_t end_jump  = emit_jump(OpCode::Jump, expr->span);
+		patch_jump(else_jump);
+		if (nif->else_body) {
+		    compile_body(nif->else_body);
+		}
+		patch_jump(end_jump);
+	    } break;
+	    case ExprKind::Loop: {
+		auto nloop = static_cast<NodeLoop*>(expr);
+		compile_expr(nloop->times);
+		if (nloop->parallel) {
+		    if (nloop->captures.size() > 255) {
+			error_manager->report(Diagnostic(DiagnosticType::Error, expr->span, "Too many captured variables", ""), true);
+		    }
+		    size_t index = chunk.functions.size();
+		    chunk.functions.push_back(FunctionInfo{0, nloop->frame_size, 1, "<ploop>"});
+		    parallel_bodies.emplace_back(nloop, index);
+		    chunk.emit_op(OpCode::ParallelLoop, expr->span);
+		    emit_index(index, expr->span, "functions");
+		    chunk.emit(nloop->captures.size(), expr->span);
+		    for (auto capture : nloop->captures) {
+			emit_index(capture.outer, expr->span, "variables");
+			emit_index(capture.inner, expr->span, "variables");
+		    }
+		    break;
+		}
+		size_t enter = emit_jump(OpCode::LoopEnter, expr->span);
+		size_t top   = chunk.code.size();
+		size_t test  = emit_jump(OpCode::LoopTest, expr->span);
+		compile_body(nloop->body);
+		chunk.emit_op(OpCode::LoopStep, expr->span);
+		chunk.emit_u32(top, expr->span);
+		patch_jump(enter);
+		patch_jump(test);
+	    } break;
+	    case ExprKind::Block: {
+		auto nblock = static_cast<NodeBlock*>(expr);
+		compile_body(nblock->body);
+		compile_expr(nblock->value);
+	    } break;
+	    case ExprKind::Nop:
+		error_manager->report(Diagnostic(DiagnosticType::Error, expr->span, "Invalid Expression", ""), true);
+		break;
+	    }
+	}
+
+	OpCode Compiler::binary_opcode(BinaryOp op) {
+	    switch (op) {
+	    case BinaryOp::Add:  return OpCode::Add;
+	    case BinaryOp::Sub:  return OpCode::Sub;
+	    case BinaryOp::Mul:  return OpCode::Mul;
+	    case BinaryOp::Div:  return OpCode::Div;
+	    case BinaryOp::Mod:  return OpCode::Mod;
+	    case BinaryOp::Shl:  return OpCode::Shl;
+	    case BinaryOp::Shr:  return OpCode::Shr;
+	    case BinaryOp::Band: return OpCode::Band;
+	    case BinaryOp::Bor:  return OpCode::Bor;
+	    case BinaryOp::Lt:   return OpCode::Lt;
+	    case BinaryOp::Le:   return OpCode::Le;
+	    case BinaryOp::Gt:   return OpCode::Gt;
+	    case BinaryOp::Ge:   return OpCode::Ge;
+	    case BinaryOp::Eq:   return OpCode::Eq;
+	    case BinaryOp::Ne:   return OpCode::Ne;
+	    default:             break;
+	    }
+	    return OpCode::Add;
+	}
+
+	size_t Compiler::string_constant(std::string_view text) {
+	    // Interning makes equal literals the same Value, so one slot each.
+	    Value::Value value = chunk.heap.intern(text);
+	    auto it = string_constants.find(value.bits);
+	    if (it != string_constants.end()) {
+		return it->second;
+	    }
+	    size_t index = chunk.add_constant(value);
+	    string_constants.emplace(value.bits, index);
+	    return index;
+	}
+
+	size_t Compiler::int_constant(int64_t number) {
+	    auto it = int_constants.find(number);
+	    if (it != int_constants.end()) {
+		return it->second;
+	    }
+	    size_t index = chunk.add_constant(chunk.heap.make_int(number));
+	    int_constants.emplace(number, index);
+	    return index;
+	}
+
+	// Slots, constants and functions are u16 operands; a program that
+	// needs more can't be encoded and is rejected instead of wrapping.
+	void Compiler::emit_index(size_t index, Span span, const char* what) {
+	    if (index > UINT16_MAX) {
+		std::stringstream s;
+		s << "Too many " << what << ": bytecode operands are limited to " << UINT16_MAX + 1;
+		error_manager->report(Diagnostic(DiagnosticType::Error, span, s.str(), ""), true);
+	    }
+	    chunk.emit_u16(index, span);
+	}
+
+	size_t Compiler::emit_jump(OpCode op, Span span) {
+	    chunk.emit_op(op, span);
+	    chunk.emit_u32(0, span);
+	    return chunk.code.size() - 4;
+	}
+
+	void Compiler::patch_jump(size_t operand) {
+	    chunk.patch_u32(operand, chunk.code.size());
+	}
+    } // namespace Runtime
+} // namespace Tisp
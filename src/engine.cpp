@@ -0,0 +1,67 @@
+#include <compiler.hpp>
+#include <engine.hpp>
+#include <module.hpp>
+#include <optimizer.hpp>
+#include <resolver.hpp>
+#include <vm.hpp>
+
+namespace Tisp {
+    static std::shared_ptr<const Program> compile_source(SourceManager sources, int file, bool optimize) {
+	ErrorManager errors(&sources);
+	errors.throw_errors = true;
+	Language::ModuleLoader loader(&sources, &errors);
+	Language::Node         ast = loader.load(file);
+	// The parser records some errors and keeps going; surface the first.
+	for (auto& diag : errors.errors) {
+	    if (diag.kind == DiagnosticType::Error) {
+		throw DiagnosticError(diag, errors.format(diag));
+	    }
+	}
+	Language::Resolver resolver(&errors);
+	resolver.resolve(ast);
+	if (optimize) {
+	    Language::Optimizer optimizer(*ast.arena);
+	    optimizer.optimize(ast);
+	}
+	Runtime::Compiler compiler(&errors);
+	Runtime::Chunk    chunk = compiler.compile(ast);
+	// Build every file's line table now; a shared Program is read-only.
+	for (size_t f = 0; f < sources.files.size(); f++) {
+	    sources.locate(f, 0);
+	}
+	auto program      = std::make_shared<Program>(std::move(sources), std::move(ast), std::move(chunk));
+	program->warnings = std::move(errors.errors);
+	return program;
+    }
+
+    std::shared_ptr<const Program> Engine::compile(const std::string& name, std::string_view source) const {
+	SourceManager sources;
+	int           file = sources.add(name, source);
+	return compile_source(std::move(sources), file, optimize);
+    }
+
+    std::shared_ptr<const Program> Engine::compile_file(const std::string& path) const {
+	SourceManager sources;
+	int           file = sources.load(path);
+	if (file < 0) {
+	    throw std::runtime_error("Unable to open '" + path + "'");
+	}
+	return compile_source(std::move(sources), file, optimize);
+    }
+
+    std::string Isolate::run() const {
+	// Declared before the Vm, whose Output still flushes into it on unwind.
+	std::string  output;
+	ErrorManager errors(&program->sources);
+	errors.throw_errors = true;
+	Language::Node globals;
+	globals.frame_size = program->ast.frame_size;
+	Runtime::Vm vm(std::move(globals), &errors);
+	vm.out.sink    = &output;
+	vm.jit.enabled = jit;
+	Runtime::Chunk chunk = program->chunk.fork();
+	vm.run(chunk);
+	vm.out.flush();
+	return output;
+    }
+} // namespace Tisp
@@ -0,0 +1,432 @@
+#include <builtins.hpp>
+#include <bytecode.hpp>
+#include <vm.hpp>
+
+using namespace Tisp::Runtime;
+using namespace Tisp::Value;
+
+// Integer fast path shared by the generic and quickened binary opcodes.
+// Returns false when the result would not be an inline int (or would trap),
+// leaving those cases to the generic path.
+static inline bool small_int_op(OpCode op, int64_t a, int64_t b, int64_t& r) {
+    switch (op) {
+    case OpCode::Add:  r = a + b; break;
+    case OpCode::Sub:  r = a - b; break;
+    case OpCode::Mul:
+	if (__builtin_mul_overflow(a, b, &r)) return false;
+	break;
+    case OpCode::Div:
+	if (b == 0) return false;
+	r = a / b;
+	break;
+    case OpCode::Mod:
+	if (b == 0) return false;
+	r = a % b;
+	break;
+    case OpCode::Shl:
+	if (b < 0 || b > 63 || ((a << b) >> b) != a) return false;
+	r = a << b;
+	break;
+    case OpCode::Shr:
+	if (b < 0 || b > 63) return false;
+	r = a >> b;
+	break;
+    case OpCode::Band: r = a & b; break;
+    case OpCode::Bor:  r = a | b; break;
+    case OpCode::Lt:   r = a < b; break;
+    case OpCode::Le:   r = a <= b; break;
+    case OpCode::Gt:   r = a > b; break;
+    case OpCode::Ge:   r = a >= b; break;
+    case OpCode::Eq:   r = a == b; break;
+    case OpCode::Ne:   r = a != b; break;
+    default: return false;
+    }
+    return Value::Value::fits_inline(r);
+}
+
+// Dispatch strategy, picked by the makefile. With TISP_THREADED_DISPATCH
+// (GCC/Clang computed goto) each handler jumps straight to the next one
+// through a label table; otherwise a portable switch in a loop is used.
+// Either way the profiler's tick count is checked before every instruction;
+// the --stats counters are only touched when enabled.
+#define VM_PROFILE()							\
+    do {								\
+	if (__builtin_expect(ticks.load(std::memory_order_relaxed), 0))	\
+	    sample(chunk, start);					\
+    } while (0)
+#if TISP_THREADED_DISPATCH
+#define VM_CASE(op) L_##op:
+#define VM_NEXT()			    \
+    do {				    \
+	start = ip;			    \
+	VM_PROFILE();			    \
+	goto* dispatch[code[ip++]];	    \
+    } while (0)
+#else
+#define VM_CASE(op) case OpCode::op:
+#define VM_NEXT() break
+#endif
+
+void Vm::run(Chunk& chunk, size_t entry, size_t base) {
+    uint8_t* code = chunk.code.data();
+    size_t         ip   = entry;
+    size_t         bp   = base; // first slot of the running function's frame
+    if (jit.hotness.size() != chunk.code.size()) {
+	jit.hotness.assign(chunk.code.size(), 0);
+    }
+    // The attached profiler's tick count. Without one, a counter nothing
+    // bumps, so the check stays a single load either way.
+    static std::atomic<uint32_t> no_ticks{0};
+    std::atomic<uint32_t>&       ticks = profiler ? profiler->pending : no_ticks;
+    auto fail = [&](size_t at, const char* message) {
+	out.flush();
+	error_manager->report(Diagnostic(DiagnosticType::Error, chunk.spans[at], message, ""), true);
+    };
+#if TISP_STATS
+    // Counts the instruction at `at` for --stats.
+    auto count = [&](size_t at) {
+	OpCode op = static_cast<OpCode>(code[at]);
+	stats.ops[size_t(op)]++;
+	if (op == OpCode::GetLocal || op == OpCode::GetGlobal) {
+	    uint16_t     slot  = chunk.read_u16(at + 1);
+	    Value::Value value = op == OpCode::GetLocal ? stack[bp + slot] : env.slots[slot];
+	    stats.lookups++;
+	    stats.misses += value.is_nil();
+	}
+    };
+#endif
+#if TISP_THREADED_DISPATCH
+    // Must list every OpCode in declaration order.
+    static const void* const labels[] = {
+	&&L_Const, &&L_Nil, &&L_Pop, &&L_GetLocal, &&L_SetLocal, &&L_GetGlobal,
+	&&L_SetGlobal, &&L_Add, &&L_Sub, &&L_Mul, &&L_Div, &&L_Mod, &&L_Shl, &&L_Shr,
+	&&L_Band, &&L_Bor, &&L_Lt, &&L_Le, &&L_Gt, &&L_Ge, &&L_Eq, &&L_Ne, &&L_AddInt,
+	&&L_SubInt, &&L_MulInt, &&L_DivInt, &&L_ModInt, &&L_ShlInt, &&L_ShrInt,
+	&&L_BandInt, &&L_BorInt, &&L_LtInt, &&L_LeInt, &&L_GtInt, &&L_GeInt, &&L_EqInt,
+	&&L_NeInt, &&L_Jump, &&L_JumpIfFalse, &&L_AndJump, &&L_OrJump, &&L_ToBool,
+	&&L_LoopEnter, &&L_LoopTest, &&L_LoopStep, &&L_LoopTestJit, &&L_ParallelLoop,
+	&&L_CallNative, &&L_Call, &&L_TailCall, &&L_Return, &&L_Halt,
+    };
+    static_assert(sizeof(labels) / sizeof(labels[0]) == size_t(OpCode::Halt) + 1);
+    const void* const* dispatch = labels;
+#if TISP_STATS
+    // With --stats every entry leads to L_Count, which then runs the real
+    // handler; a build or run without it dispatches straight through labels.
+    const void* counting[std::size(labels)];
+    if (stats.enabled) {
+	std::fill(std::begin(counting), std::end(counting), &&L_Count);
+	dispatch = counting;
+    }
+#endif
+    size_t start;
+    VM_NEXT();
+#else
+    for (;;) {
+	size_t start = ip;
+	VM_PROFILE();
+	TISP_STAT(if (stats.enabled) count(start));
+	switch (static_cast<OpCode>(code[ip++])) {
+#endif
+	VM_CASE(Const)
+	    stack.push_back(chunk.constants[chunk.read_u16(ip)]);
+	    ip += 2;
+	    VM_NEXT();
+	VM_CASE(Nil)
+	    stack.push_back(Value::Value::nil());
+	    VM_NEXT();
+	VM_CASE(Pop)
+	    stack.pop_back();
+	    VM_NEXT();
+	VM_CASE(GetLocal) {
+	    Value::Value value = stack[bp + chunk.read_u16(ip)];
+	    stack.push_back(value);
+	    ip += 2;
+	} VM_NEXT();
+	VM_CASE(SetLocal)
+	    stack[bp + chunk.read_u16(ip)] = stack.back();
+	    stack.pop_back();
+	    ip += 2;
+	    VM_NEXT();
+	VM_CASE(GetGlobal)
+	    stack.push_back(env.slots[chunk.read_u16(ip)]);
+	    ip += 2;
+	    VM_NEXT();
+	VM_CASE(SetGlobal)
+	    env.slots[chunk.read_u16(ip)] = stack.back();
+	    stack.pop_back();
+	    ip += 2;
+	    VM_NEXT();
+	VM_CASE(Add)
+	VM_CASE(Sub)
+	VM_CASE(Mul)
+	VM_CASE(Div)
+	VM_CASE(Mod)
+	VM_CASE(Shl)
+	VM_CASE(Shr)
+	VM_CASE(Band)
+	VM_CASE(Bor)
+	VM_CASE(Lt)
+	VM_CASE(Le)
+	VM_CASE(Gt)
+	VM_CASE(Ge)
+	VM_CASE(Eq)
+	VM_CASE(Ne) {
+	    Value::Value rhs = stack.back();
+	    stack.pop_back();
+	    Value::Value lhs = stack.back();
+	    stack.pop_back();
+	    OpCode  op = static_cast<OpCode>(code[start]);
+	    if ((op == OpCode::Eq || op == OpCode::Ne) && !(lhs.is_int() && rhs.is_int())) {
+		stack.push_back(Value::Value::small_int(lhs.equals(rhs) == (op == OpCode::Eq)));
+		VM_NEXT();
+	    }
+	    if (!lhs.is_int() || !rhs.is_int()) {
+		fail(start, "Operands must be numbers");
+	    }
+	    int64_t r  = 0;
+	    if (lhs.is_small_int() && rhs.is_small_int() &&
+		small_int_op(op, lhs.small_int_value(), rhs.small_int_value(), r)) {
+		code[start] = static_cast<uint8_t>(quickened(op));
+		stack.push_back(Value::Value::small_int(r));
+		VM_NEXT();
+	    }
+	    int64_t a = lhs.as_int();
+	    int64_t b = rhs.as_int();
+	    switch (op) {
+	    case OpCode::Add:
+		if (__builtin_add_overflow(a, b, &r)) fail(start, "Integer overflow");
+		break;
+	    case OpCode::Sub:
+		if (__builtin_sub_overflow(a, b, &r)) fail(start, "Integer overflow");
+		break;
+	    case OpCode::Mul:
+		if (__builtin_mul_overflow(a, b, &r)) fail(start, "Integer overflow");
+		break;
+	    case OpCode::Div:
+		if (b == 0) fail(start, "Division by zero");
+		if (b == -1 && a == INT64_MIN) fail(start, "Integer overflow");
+		r = a / b;
+		break;
+	    case OpCode::Mod:
+		if (b == 0) fail(start, "Division by zero");
+		// INT64_MIN % -1 traps, though the result is 0.
+		r = b == -1 ? 0 : a % b;
+		break;
+	    case OpCode::Shl:
+	    case OpCode::Shr:
+		if (b < 0 || b > 63) fail(start, "Shift count out of range");
+		r = op == OpCode::Shl ? a << b : a >> b;
+		break;
+	    case OpCode::Band: r = a & b;  break;
+	    case OpCode::Bor:  r = a | b;  break;
+	    case OpCode::Lt:   r = a < b;  break;
+	    case OpCode::Le:   r = a <= b; break;
+	    case OpCode::Gt:   r = a > b;  break;
+	    case OpCode::Ge:   r = a >= b; break;
+	    case OpCode::Eq:   r = a == b; break;
+	    case OpCode::Ne:   r = a != b; break;
+	    default: break;
+	    }
+	    stack.push_back(heap.make_int(r));
+	} VM_NEXT();
+	VM_CASE(AddInt)
+	VM_CASE(SubInt)
+	VM_CASE(MulInt)
+	VM_CASE(DivInt)
+	VM_CASE(ModInt)
+	VM_CASE(ShlInt)
+	VM_CASE(ShrInt)
+	VM_CASE(BandInt)
+	VM_CASE(BorInt)
+	VM_CASE(LtInt)
+	VM_CASE(LeInt)
+	VM_CASE(GtInt)
+	VM_CASE(GeInt)
+	VM_CASE(EqInt)
+	VM_CASE(NeInt) {
+	    Value::Value rhs = stack[stack.size() - 1];
+	    Value::Value lhs = stack[stack.size() - 2];
+	    int64_t      r;
+	    if (lhs.is_small_int() && rhs.is_small_int() &&
+		small_int_op(generic(static_cast<OpCode>(code[start])), lhs.small_int_value(), rhs.small_int_value(), r)) {
+		stack.pop_back();
+		stack.back() = Value::Value::small_int(r);
+		VM_NEXT();
+	    }
+	    // The operands no longer fit the fast path: go back to the generic op.
+	    code[start] = static_cast<uint8_t>(generic(static_cast<OpCode>(code[start])));
+	    ip = start;
+	} VM_NEXT();
+	VM_CASE(Jump)
+	    ip = chunk.read_u32(ip);
+	    // Jumps and loop steps are the safe points: between instructions
+	    // every live value is on the stack or in a slot.
+	    if (heap.should_collect()) {
+		collect_garbage();
+	    }
+	    VM_NEXT();
+	VM_CASE(JumpIfFalse)
+	    if (!stack.back().is_truthy()) {
+		ip = chunk.read_u32(ip);
+	    } else {
+		ip += 4;
+	    }
+	    VM_NEXT();
+	VM_CASE(AndJump)
+	VM_CASE(OrJump) {
+	    if (!stack.back().is_int()) {
+		fail(start, "Operands must be numbers");
+	    }
+	    bool lhs = stack.back().as_int() != 0;
+	    if (lhs == (static_cast<OpCode>(code[start]) == OpCode::OrJump)) {
+		stack.back() = Value::Value::small_int(lhs);
+		ip = chunk.read_u32(ip);
+	    } else {
+		stack.pop_back();
+		ip += 4;
+	    }
+	} VM_NEXT();
+	VM_CASE(ToBool)
+	    if (!stack.back().is_int()) {
+		fail(start, "Operands must be numbers");
+	    }
+	    stack.back() = Value::Value::small_int(stack.back().as_int() != 0);
+	    VM_NEXT();
+	VM_CASE(LoopEnter)
+	    if (!stack.back().is_int()) {
+		ip = chunk.read_u32(ip);
+		VM_NEXT();
+	    }
+	    stack.push_back(Value::Value::small_int(0));
+	    ip += 4;
+	    VM_NEXT();
+	VM_CASE(LoopTest) {
+	    int64_t i     = stack.back().small_int_value();
+	    int64_t times = stack[stack.size() - 2].as_int();
+	    if (i >= times) {
+		stack.pop_back();
+		ip = chunk.read_u32(ip);
+	    } else {
+		ip += 4;
+	    }
+	} VM_NEXT();
+	VM_CASE(LoopStep)
+	    stack.back() = heap.make_int(stack.back().as_int() + 1);
+	    ip = chunk.read_u32(ip);
+	    if (jit.enabled && jit.hotness[start] < Jit::threshold && ++jit.hotness[start] == Jit::threshold) {
+		// Hot loop: try to compile it once and route its LoopTest there.
+		JitLoop& loop = jit.loops[code + ip];
+		loop.fn       = jit.compile_loop(chunk, ip, start);
+		loop.exit     = chunk.read_u32(ip + 1);
+		if (loop.fn) {
+		    code[ip] = static_cast<uint8_t>(OpCode::LoopTestJit);
+		}
+	    }
+	    if (heap.should_collect()) {
+		collect_garbage();
+	    }
+	    VM_NEXT();
+	VM_CASE(LoopTestJit) {
+	    JitLoop& loop = jit.loops[code + start];
+	    JitState state;
+	    state.globals = reinterpret_cast<uint64_t*>(env.slots.data());
+	    state.locals  = reinterpret_cast<uint64_t*>(stack.data() + bp);
+	    state.counter = stack.back().small_int_value();
+	    state.times   = stack[stack.size() - 2].as_int();
+	    uint64_t result = loop.fn(&state);
+	    // Ticks that came in while the native code ran belong to the loop,
+	    // not to whatever runs next.
+	    if (ticks.load(std::memory_order_relaxed)) {
+		sample(chunk, start);
+	    }
+	    uint32_t resume = uint32_t(result);
+	    uint32_t depth  = uint32_t(result >> 32);
+	    if (resume == loop.exit) {
+		stack.pop_back();
+		ip = resume;
+		VM_NEXT();
+	    }
+	    // Bailout: rebuild the interpreter's view and finish the iteration
+	    // there. A loop that keeps bailing goes back to plain LoopTest.
+	    stack.back() = Value::Value::small_int(state.counter);
+	    for (uint32_t i = 0; i < depth; i++) {
+		stack.push_back(Value::Value::small_int(state.spill[i]));
+	    }
+	    ip = resume;
+	    if (++loop.deopts == Jit::max_deopts) {
+		code[start] = static_cast<uint8_t>(OpCode::LoopTest);
+	    }
+	} VM_NEXT();
+	VM_CASE(ParallelLoop) {
+	    const FunctionInfo& fn       = chunk.functions[chunk.read_u16(ip)];
+	    uint8_t		count    = code[ip + 2];
+	    size_t		captures = ip + 3;
+	    ip = captures + 4 * count;
+	    // Like LoopEnter, a count that isn't a number runs nothing.
+	    if (!stack.back().is_int()) {
+		VM_NEXT();
+	    }
+	    std::vector<Value::Value> frame(fn.frame_size);
+	    for (size_t c = captures; c < ip; c += 4) {
+		frame[chunk.read_u16(c + 2)] = stack[bp + chunk.read_u16(c)];
+	    }
+	    parallel_loop(LoopBody{&chunk, fn.entry, nullptr}, stack.back().as_int(), frame);
+	} VM_NEXT();
+	VM_CASE(CallNative) {
+	    uint16_t native = chunk.read_u16(ip);
+	    uint8_t  argc   = code[ip + 2];
+	    ip += 3;
+	    // Arguments are passed in place; natives must not push to the stack.
+	    Value::Value result = call_native(native, Args(stack.data() + stack.size() - argc, argc), chunk.spans[start]);
+	    stack.resize(stack.size() - argc);
+	    stack.push_back(result);
+	    if (heap.should_collect()) {
+		collect_garbage();
+	    }
+	} VM_NEXT();
+	VM_CASE(Call) {
+	    const FunctionInfo& fn   = chunk.functions[chunk.read_u16(ip)];
+	    uint8_t		argc = code[ip + 2];
+	    if (frames.size() >= max_frames) {
+		fail(start, "Stack overflow");
+	    }
+	    frames.push_back(Frame{ip + 3, bp});
+	    bp = stack.size() - argc;
+	    // Arguments become the first slots; the remaining locals start nil.
+	    stack.resize(bp + fn.frame_size);
+	    ip = fn.entry;
+	} VM_NEXT();
+	VM_CASE(TailCall) {
+	    const FunctionInfo& fn   = chunk.functions[chunk.read_u16(ip)];
+	    uint8_t		argc = code[ip + 2];
+	    // Slide the new arguments over the current frame and jump: the
+	    // frame stack does not grow, however deep the tail recursion goes.
+	    std::copy(stack.end() - argc, stack.end(), stack.begin() + bp);
+	    stack.resize(bp + argc);
+	    stack.resize(bp + fn.frame_size);
+	    ip = fn.entry;
+	} VM_NEXT();
+	VM_CASE(Return) {
+	    Value::Value result = stack.back();
+	    Frame        frame  = frames.back();
+	    frames.pop_back();
+	    stack.resize(bp);
+	    stack.push_back(result);
+	    ip = frame.return_ip;
+	    bp = frame.bp;
+	} VM_NEXT();
+	VM_CASE(Halt)
+	    return;
+#if !TISP_THREADED_DISPATCH
+	}
+    }
+#elif TISP_STATS
+    L_Count:
+	count(start);
+	goto* labels[code[start]];
+#endif
+}
+
+#undef VM_PROFILE
+#undef VM_CASE
+#undef VM_NEXT
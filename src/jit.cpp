@@ -0,0 +1,418 @@
+#include <cstddef>
+#include <cstring>
+#include <jit.hpp>
+#include <sys/mman.h>
+
+namespace Tisp {
+    namespace Runtime {
+	Jit::~Jit() {
+	    for (auto& region : regions) {
+		munmap(region.first, region.second);
+	    }
+	}
+
+#if defined(__x86_64__) && defined(__linux__)
+	namespace {
+	    enum Reg { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+		       R12 = 12, R13 = 13, R14 = 14, R15 = 15 };
+
+	    // Condition codes, as used by Jcc (0x0f 0x80+cc) and SETcc (0x0f 0x90+cc).
+	    enum Cond { CO = 0x0, CA = 0x7, CE = 0x4, CNE = 0x5, CL = 0xc, CGE = 0xd, CLE = 0xe, CG = 0xf };
+
+	    // Just enough of an x86-64 encoder for the loop templates below. All
+	    // arithmetic is 64-bit; memory operands are always [base + disp32].
+	    struct Assembler {
+		std::vector<uint8_t> code;
+
+		void byte(uint8_t b) { code.push_back(b); }
+		void u32(uint32_t v) {
+		    for (int i = 0; i < 4; i++) byte(v >> (i * 8));
+		}
+		void u64(uint64_t v) {
+		    for (int i = 0; i < 8; i++) byte(v >> (i * 8));
+		}
+		void rex(int reg, int rm) {
+		    byte(0x48 | ((reg >> 3) << 2) | (rm >> 3));
+		}
+		// op r/m64, r64 (or the reverse, depending on the opcode)
+		void rr(uint8_t op, int reg, int rm) {
+		    rex(reg, rm);
+		    byte(op);
+		    byte(0xc0 | ((reg & 7) << 3) | (rm & 7));
+		}
+		void mem(uint8_t op, int reg, int base, int32_t disp) {
+		    rex(reg, base);
+		    byte(op);
+		    byte(0x80 | ((reg & 7) << 3) | (base & 7));
+		    if ((base & 7) == RSP) byte(0x24);
+		    u32(disp);
+		}
+		void load(int reg, int base, int32_t disp)  { mem(0x8b, reg, base, disp); }
+		void store(int base, int32_t disp, int reg) { mem(0x89, reg, base, disp); }
+		void lea(int reg, int base, int32_t disp)   { mem(0x8d, reg, base, disp); }
+		void mov_imm(int reg, uint64_t imm) {
+		    rex(0, reg);
+		    byte(0xb8 | (reg & 7));
+		    u64(imm);
+		}
+		// cmp qword [base + disp], imm8
+		void cmp_mem_imm8(int base, int32_t disp, int8_t imm) {
+		    mem(0x83, 7, base, disp);
+		    byte(imm);
+		}
+		void cmp_imm32(int reg, int32_t imm) {
+		    rex(0, reg);
+		    byte(0x81);
+		    byte(0xc0 | (7 << 3) | (reg & 7));
+		    u32(imm);
+		}
+		void shift_imm(int ext, int reg, uint8_t n) { // ext: 4 shl, 5 shr, 7 sar
+		    rex(0, reg);
+		    byte(0xc1);
+		    byte(0xc0 | (ext << 3) | (reg & 7));
+		    byte(n);
+		}
+		void shift_cl(int ext, int reg) {
+		    rex(0, reg);
+		    byte(0xd3);
+		    byte(0xc0 | (ext << 3) | (reg & 7));
+		}
+		void push(int reg) {
+		    if (reg >= 8) byte(0x41);
+		    byte(0x50 | (reg & 7));
+		}
+		void pop(int reg) {
+		    if (reg >= 8) byte(0x41);
+		    byte(0x58 | (reg & 7));
+		}
+		void setcc(int cc) {
+		    byte(0x0f);
+		    byte(0x90 | cc);
+		    byte(0xc0); // al
+		    byte(0x0f); // movzx eax, al
+		    byte(0xb6);
+		    byte(0xc0);
+		}
+		// Emits a rel32 jump and returns the offset of its displacement.
+		size_t jcc(int cc) {
+		    byte(0x0f);
+		    byte(0x80 | cc);
+		    u32(0);
+		    return code.size() - 4;
+		}
+		size_t jmp() {
+		    byte(0xe9);
+		    u32(0);
+		    return code.size() - 4;
+		}
+		void patch(size_t at, size_t target) {
+		    int32_t rel = int32_t(target) - int32_t(at + 4);
+		    memcpy(&code[at], &rel, 4);
+		}
+	    };
+
+	    constexpr uint64_t INT_TAG  = Value::Value::QNAN | Value::Value::TAG_INT;
+	    constexpr int32_t  TAG_HIGH = INT_TAG >> 48;
+
+	    bool supported(OpCode op) {
+		switch (op) {
+		case OpCode::Const:
+		case OpCode::Pop:
+		case OpCode::GetLocal:
+		case OpCode::SetLocal:
+		case OpCode::GetGlobal:
+		case OpCode::SetGlobal:
+		case OpCode::Jump:
+		case OpCode::JumpIfFalse:
+		case OpCode::AndJump:
+		case OpCode::OrJump:
+		case OpCode::ToBool:
+		    return true;
+		default:
+		    return (op >= OpCode::Add && op <= OpCode::Ne) || (op >= OpCode::AddInt && op <= OpCode::NeInt);
+		}
+	    }
+
+	    size_t width(OpCode op) {
+		switch (op) {
+		case OpCode::Const:
+		case OpCode::GetLocal:
+		case OpCode::SetLocal:
+		case OpCode::GetGlobal:
+		case OpCode::SetGlobal:
+		    return 3;
+		case OpCode::Jump:
+		case OpCode::JumpIfFalse:
+		case OpCode::AndJump:
+		case OpCode::OrJump:
+		    return 5;
+		default:
+		    return 1;
+		}
+	    }
+
+	    int stack_effect(OpCode op) {
+		switch (op) {
+		case OpCode::Const:
+		case OpCode::GetLocal:
+		case OpCode::GetGlobal:
+		    return 1;
+		case OpCode::Pop:
+		case OpCode::SetLocal:
+		case OpCode::SetGlobal:
+		    return -1;
+		case OpCode::Jump:
+		case OpCode::JumpIfFalse:
+		case OpCode::ToBool:
+		    return 0;
+		case OpCode::AndJump:
+		case OpCode::OrJump:
+		    return -1; // on the fall-through path
+		default:
+		    return -1; // binary operators
+		}
+	    }
+	}
+
+	JitFn Jit::compile_loop(const Chunk& chunk, size_t test, size_t step) {
+	    const uint8_t* code  = chunk.code.data();
+	    size_t         begin = test + 5;
+	    uint32_t       exit  = chunk.read_u32(test + 1);
+
+	    // Pass 1: check every instruction and work out the operand stack
+	    // depth at each one. Branches may only go forward, to the LoopStep
+	    // at the latest, and must agree on the depth where they land.
+	    std::vector<int> depth(step - test + 1, -1);
+	    auto at = [&](size_t ip) -> int& { return depth[ip - test]; };
+	    at(begin) = 0;
+	    for (size_t ip = begin; ip < step;) {
+		OpCode op = static_cast<OpCode>(code[ip]);
+		if (!supported(op)) return nullptr;
+		int d = at(ip);
+		if (d < 0) return nullptr; // unreachable code; keep it simple
+		if (op == OpCode::Const && !chunk.constants[chunk.read_u16(ip + 1)].is_small_int()) return nullptr;
+		size_t next = ip + width(op);
+		int    out  = d + stack_effect(op);
+		int    need = (op >= OpCode::Add && op <= OpCode::Ne) || (op >= OpCode::AddInt && op <= OpCode::NeInt) ? 2
+			      : (op == OpCode::Const || op == OpCode::GetLocal || op == OpCode::GetGlobal || op == OpCode::Jump) ? 0
+			      : 1;
+		if (d < need || out + 1 >= int(JitState::max_depth) || next > step) return nullptr;
+		if (op == OpCode::Jump || op == OpCode::JumpIfFalse || op == OpCode::AndJump || op == OpCode::OrJump) {
+		    size_t target = chunk.read_u32(ip + 1);
+		    if (target < next || target > step) return nullptr;
+		    if (at(target) >= 0 && at(target) != d) return nullptr;
+		    at(target) = d;
+		}
+		if (op != OpCode::Jump) {
+		    if (at(next) >= 0 && at(next) != out) return nullptr;
+		    at(next) = out;
+		}
+		ip = next;
+	    }
+	    if (at(step) != 0) return nullptr;
+
+	    // Pass 2: emit. rbp = state, r12 = globals, r13 = locals,
+	    // r14 = spill area, rbx = counter, r15 = times.
+	    Assembler a;
+	    struct Bailout {
+		size_t   jump;
+		uint32_t ip;
+		uint32_t depth;
+	    };
+	    std::vector<Bailout>                  bailouts;
+	    std::vector<std::pair<size_t, size_t>> branches; // (displacement, bytecode target)
+	    std::vector<size_t>                   native(step - test + 1, 0);
+
+	    for (int reg : {RBX, RBP, R12, R13, R14, R15}) a.push(reg);
+	    a.rr(0x89, RDI, RBP);
+	    a.load(R12, RBP, offsetof(JitState, globals));
+	    a.load(R13, RBP, offsetof(JitState, locals));
+	    a.lea(R14, RBP, offsetof(JitState, spill));
+	    a.load(RBX, RBP, offsetof(JitState, counter));
+	    a.load(R15, RBP, offsetof(JitState, times));
+
+	    size_t top = a.code.size();
+	    a.rr(0x39, R15, RBX); // cmp rbx, r15
+	    size_t to_exit = a.jcc(CGE);
+
+	    auto bail = [&](int cc, size_t ip, int d) {
+		bailouts.push_back({a.jcc(cc), uint32_t(ip), uint32_t(d)});
+	    };
+	    // rax must hold an int that fits in 48 bits.
+	    auto check_fits = [&](size_t ip, int d) {
+		a.rr(0x89, RAX, RDX);
+		a.shift_imm(4, RDX, 16);
+		a.shift_imm(7, RDX, 16);
+		a.rr(0x39, RAX, RDX);
+		bail(CNE, ip, d);
+	    };
+
+	    for (size_t ip = begin; ip < step;) {
+		native[ip - test] = a.code.size();
+		OpCode op = static_cast<OpCode>(code[ip]);
+		int    d  = at(ip);
+		if (op >= OpCode::AddInt && op <= OpCode::NeInt) {
+		    op = generic(op);
+		}
+		switch (op) {
+		case OpCode::Const:
+		    a.mov_imm(RAX, chunk.constants[chunk.read_u16(ip + 1)].small_int_value());
+		    a.store(R14, 8 * d, RAX);
+		    break;
+		case OpCode::GetLocal:
+		case OpCode::GetGlobal:
+		    a.load(RAX, op == OpCode::GetLocal ? R13 : R12, 8 * chunk.read_u16(ip + 1));
+		    a.rr(0x89, RAX, RCX);
+		    a.shift_imm(5, RCX, 48);
+		    a.cmp_imm32(RCX, TAG_HIGH);
+		    bail(CNE, ip, d);
+		    a.shift_imm(4, RAX, 16);
+		    a.shift_imm(7, RAX, 16);
+		    a.store(R14, 8 * d, RAX);
+		    break;
+		case OpCode::SetLocal:
+		case OpCode::SetGlobal:
+		    a.load(RAX, R14, 8 * (d - 1));
+		    a.mov_imm(RCX, Value::Value::PAYLOAD);
+		    a.rr(0x21, RCX, RAX);
+		    a.mov_imm(RCX, INT_TAG);
+		    a.rr(0x09, RCX, RAX);
+		    a.store(op == OpCode::SetLocal ? R13 : R12, 8 * chunk.read_u16(ip + 1), RAX);
+		    break;
+		case OpCode::Pop:
+		    break;
+		case OpCode::Jump:
+		    branches.push_back({a.jmp(), chunk.read_u32(ip + 1)});
+		    break;
+		case OpCode::JumpIfFalse:
+		    // Truthy means > 0.
+		    a.cmp_mem_imm8(R14, 8 * (d - 1), 0);
+		    branches.push_back({a.jcc(CLE), chunk.read_u32(ip + 1)});
+		    break;
+		case OpCode::AndJump:
+		    // A zero lhs is already the result.
+		    a.cmp_mem_imm8(R14, 8 * (d - 1), 0);
+		    branches.push_back({a.jcc(CE), chunk.read_u32(ip + 1)});
+		    break;
+		case OpCode::OrJump: {
+		    a.cmp_mem_imm8(R14, 8 * (d - 1), 0);
+		    size_t skip = a.jcc(CE);
+		    a.mov_imm(RAX, 1);
+		    a.store(R14, 8 * (d - 1), RAX);
+		    branches.push_back({a.jmp(), chunk.read_u32(ip + 1)});
+		    a.patch(skip, a.code.size());
+		} break;
+		case OpCode::ToBool:
+		    a.load(RAX, R14, 8 * (d - 1));
+		    a.rr(0x85, RAX, RAX);
+		    a.setcc(CNE);
+		    a.store(R14, 8 * (d - 1), RAX);
+		    break;
+		default: {
+		    // Binary operator: lhs in rax, rhs in rcx, result to the lhs slot.
+		    a.load(RAX, R14, 8 * (d - 2));
+		    a.load(RCX, R14, 8 * (d - 1));
+		    switch (op) {
+		    case OpCode::Add:
+			a.rr(0x01, RCX, RAX);
+			check_fits(ip, d);
+			break;
+		    case OpCode::Sub:
+			a.rr(0x29, RCX, RAX);
+			check_fits(ip, d);
+			break;
+		    case OpCode::Mul:
+			a.byte(0x48); // imul rax, rcx
+			a.byte(0x0f);
+			a.byte(0xaf);
+			a.byte(0xc1);
+			bail(CO, ip, d);
+			check_fits(ip, d);
+			break;
+		    case OpCode::Div:
+		    case OpCode::Mod:
+			a.rr(0x85, RCX, RCX);
+			bail(CE, ip, d);
+			a.byte(0x48); // cqo
+			a.byte(0x99);
+			a.rr(0xf7, 7, RCX); // idiv rcx
+			if (op == OpCode::Mod) a.rr(0x89, RDX, RAX);
+			check_fits(ip, d);
+			break;
+		    case OpCode::Shl:
+			a.cmp_imm32(RCX, 63);
+			bail(CA, ip, d);
+			a.rr(0x89, RAX, RDX);
+			a.shift_cl(4, RAX);
+			a.rr(0x89, RAX, RSI);
+			a.shift_cl(7, RSI);
+			a.rr(0x39, RDX, RSI);
+			bail(CNE, ip, d);
+			check_fits(ip, d);
+			break;
+		    case OpCode::Shr:
+			a.cmp_imm32(RCX, 63);
+			bail(CA, ip, d);
+			a.shift_cl(7, RAX);
+			break;
+		    case OpCode::Band: a.rr(0x21, RCX, RAX); break;
+		    case OpCode::Bor:  a.rr(0x09, RCX, RAX); break;
+		    case OpCode::Lt: a.rr(0x39, RCX, RAX); a.setcc(CL);  break;
+		    case OpCode::Le: a.rr(0x39, RCX, RAX); a.setcc(CLE); break;
+		    case OpCode::Gt: a.rr(0x39, RCX, RAX); a.setcc(CG);  break;
+		    case OpCode::Ge: a.rr(0x39, RCX, RAX); a.setcc(CGE); break;
+		    case OpCode::Eq: a.rr(0x39, RCX, RAX); a.setcc(CE);  break;
+		    case OpCode::Ne: a.rr(0x39, RCX, RAX); a.setcc(CNE); break;
+		    default:
+			return nullptr;
+		    }
+		    a.store(R14, 8 * (d - 2), RAX);
+		} break;
+		}
+		ip += width(static_cast<OpCode>(code[ip]));
+	    }
+
+	    // LoopStep: next iteration.
+	    native[step - test] = a.code.size();
+	    a.rr(0xff, 0, RBX); // inc rbx
+	    a.patch(a.jmp(), top);
+
+	    // Loop finished: resume at the exit with an empty operand stack.
+	    std::vector<size_t> to_epilogue;
+	    a.patch(to_exit, a.code.size());
+	    a.mov_imm(RAX, exit);
+	    to_epilogue.push_back(a.jmp());
+
+	    // Bailouts resume the interpreter at the failing instruction.
+	    for (auto& b : bailouts) {
+		a.patch(b.jump, a.code.size());
+		a.mov_imm(RAX, (uint64_t(b.depth) << 32) | b.ip);
+		to_epilogue.push_back(a.jmp());
+	    }
+
+	    size_t epilogue = a.code.size();
+	    a.store(RBP, offsetof(JitState, counter), RBX);
+	    for (int reg : {R15, R14, R13, R12, RBP, RBX}) a.pop(reg);
+	    a.byte(0xc3);
+
+	    for (auto j : to_epilogue) a.patch(j, epilogue);
+	    for (auto& br : branches) a.patch(br.first, native[br.second - test]);
+
+	    size_t size = (a.code.size() + 4095) & ~size_t(4095);
+	    void*  mem  = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	    if (mem == MAP_FAILED) return nullptr;
+	    memcpy(mem, a.code.data(), a.code.size());
+	    if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+		munmap(mem, size);
+		return nullptr;
+	    }
+	    regions.push_back({mem, size});
+	    return reinterpret_cast<JitFn>(mem);
+	}
+#else
+	JitFn Jit::compile_loop(const Chunk&, size_t, size_t) {
+	    return nullptr;
+	}
+#endif
+    } // namespace Runtime
+} // namespace Tisp
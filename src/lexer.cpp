@@ -1,187 +1,189 @@
 #include <cstdio>
-#include <filesystem>
-#include <fstream>
 #include <iostream>
 #include <lexer.hpp>
 #include <sstream>
 
-namespace fs = std::filesystem;
-
 namespace Tisp {
     namespace Language {
-	Lexer::Lexer(std::string filename) {
-	    this->filename = filename;
-	    if (!fs::exists(filename)) {
-		std::cout << "Unable to open '" << filename
-		<< "' : No Such file or directory\n";
-		exit(1);
-	    }
-	    std::fstream f = std::fstream(filename, std::ios::in);
-	    std::stringstream s;
-	    s << f.rdbuf();
-	    source = s.str();
+	Lexer::Lexer(SourceManager* sources, uint16_t file) : file(file) {
+	    source = sources->text(file);
 	}
 	char Lexer::now() {
 	    if (pos >= source.size()) {
 		return EOF;
 	    }
-	    return source.at(pos);
+	    return source[pos];
 	}
 	char Lexer::peek() {
 	    if (pos + 1 >= source.size()) {
 		return EOF;
 	    }
-	    return source.at(pos + 1);
+	    return source[pos + 1];
 	}
 	char Lexer::before() {
 	    if (pos - 1 < 0) {
 		return EOF;
 	    }
-	    return source.at(pos - 1);
+	    return source[pos - 1];
 	}
 	char Lexer::advance() {
 	    char ch = now();
-	    if (ch == '\n') {
-		line++;
-		column = 1;
-	    } else {
-		column++;
-	    }
 	    pos++;
 	    return ch;
 	}
 	Tokens Lexer::parse() {
 	    Tokens tokens;
+	    tokens.file   = file;
+	    tokens.source = source;
+	    // Roughly one token per four bytes of source keeps regrowth rare.
+	    tokens.kinds.reserve(source.size() / 4 + 1);
+	    tokens.offsets.reserve(source.size() / 4 + 1);
+	    tokens.lengths.reserve(source.size() / 4 + 1);
 	    while (now() != EOF) {
 		if (isspace(now())) {
 		    advance();
 		    continue;
 		}
 		if (isalpha(now()) || now() == '_') {
-		    std::string buf;
-		    int sc = column;
+		    int start = pos;
+		    int sc = pos;
 		    while (now() != EOF && (isalnum(now()) || now() == '_')) {
-			buf += advance();
+			advance();
 		    }
+		    std::string_view buf = source.substr(start, pos - start);
 		    // TODO: add all keywords
 		    if (buf == "end" || buf == "func" || buf == "import" || buf == "if" ||
-		    buf == "let" || buf == "if" || buf == "elif" || buf == "else" || buf == "loop" ) {
-			tokens.push_back(Token(TokenKind::KEYWORD, buf,
-                        Span(filename.c_str(), line, sc, column - 1)));
+		    buf == "let" || buf == "if" || buf == "elif" || buf == "else" || buf == "loop" || buf == "ploop" || buf == "as" || buf == "return") {
+			tokens.push(TokenKind::KEYWORD, sc, pos - sc);
 			continue;
 		    }
-		    tokens.push_back(Token(TokenKind::NAME, buf,
-                    Span(filename.c_str(), line, sc, column - 1)));
+		    tokens.push(TokenKind::NAME, sc, pos - sc);
 		    continue;
 		}
 		if (isdigit(now())) {
-		    std::string buf;
-		    int sc = column;
+		    int sc = pos;
 		    while (now() != EOF && isdigit(now())) {
-			buf += advance();
+			advance();
 		    }
-		    tokens.push_back(Token(TokenKind::NUMBER, buf,
-                    Span(filename.c_str(), line, sc, column - 1)));
+		    tokens.push(TokenKind::NUMBER, sc, pos - sc);
 		    continue;
 		}
 		if (now() == '\"') {
 		    advance();
-		    std::string buf;
-		    int sc = column;
-		    while (now() != '\"') {
-			buf += advance();
+		    int sc = pos;
+		    while (now() != '\"' && now() != EOF) {
+			advance();
 		    }
+		    // The token covers the contents only, not the quotes.
+		    tokens.push(TokenKind::STRING, sc, pos - sc);
 		    advance();
-		    tokens.push_back(Token(TokenKind::STRING, buf,
-                    Span(filename.c_str(), line, sc, column - 1)));
 		    continue;
 		}
-		int sc = column;
+		int sc = pos;
 		switch (now()) {
 		case '=':
 		    advance();
-		    tokens.push_back(Token(TokenKind::EQ, "=",
-                    Span(filename.c_str(), line, sc, column - 1)));
+		    if (now() == '=') {
+			advance();
+			tokens.push(TokenKind::EQEQ, sc, pos - sc);
+			break;
+		    }
+		    tokens.push(TokenKind::EQ, sc, pos - sc);
+		    break;
+		case '!':
+		    if (peek() != '=') {
+			std::stringstream s;
+			s << "Unexpected char: '" << now() << "'\n";
+			error_manager->report(Diagnostic(DiagnosticType::Error, Span(file, pos, 1), s.str(), ""), true);
+		    }
+		    advance();
+		    advance();
+		    tokens.push(TokenKind::NE, sc, pos - sc);
 		    break;
 		case '+':
 		    advance();
-		    tokens.push_back(Token(TokenKind::ADD, "+",
-                    Span(filename.c_str(), line, sc, column - 1)));
+		    tokens.push(TokenKind::ADD, sc, pos - sc);
 		    break;
 		case '-':
 		    advance();
-		    tokens.push_back(Token(TokenKind::SUB, "-",
-                    Span(filename.c_str(), line, sc, column - 1)));
+		    tokens.push(TokenKind::SUB, sc, pos - sc);
 		    break;
 		case '*':
 		    advance();
-		    tokens.push_back(Token(TokenKind::SUB, "*",
-                    Span(filename.c_str(), line, sc, column - 1)));
+		    tokens.push(TokenKind::MUL, sc, pos - sc);
+		    break;
+		case '%':
+		    advance();
+		    tokens.push(TokenKind::MOD, sc, pos - sc);
 		    break;
+		case '<':
+		case '>': {
+		    char ch = advance();
+		    if (now() == ch) {
+			advance();
+			tokens.push(ch == '<' ? TokenKind::SHL : TokenKind::SHR, sc, pos - sc);
+		    } else if (now() == '=') {
+			advance();
+			tokens.push(ch == '<' ? TokenKind::LE : TokenKind::GE, sc, pos - sc);
+		    } else {
+			tokens.push(ch == '<' ? TokenKind::LT : TokenKind::GT, sc, pos - sc);
+		    }
+		} break;
 		case '/':
 		    advance();
 		    if (now() == '/') {
 			advance();
-			while (now() != '\n') advance();
+			while (now() != '\n' && now() != EOF) advance();
 			continue;
 		    }
-		    tokens.push_back(Token(TokenKind::DIV, "/",
-                    Span(filename.c_str(), line, sc, column - 1)));
+		    tokens.push(TokenKind::DIV, sc, pos - sc);
 		    break;
 		case '|':
 		    advance();
 		    if (now() == '|') {
 			advance();
-			tokens.push_back(Token(TokenKind::OR, "||",
-			Span(filename.c_str(), line, sc, column - 1)));
+			tokens.push(TokenKind::OR, sc, pos - sc);
 			break;
 		    }
-		    tokens.push_back(Token(TokenKind::BOR, "|",
-                    Span(filename.c_str(), line, sc, column - 1)));
+		    tokens.push(TokenKind::BOR, sc, pos - sc);
+		    break;
 		case '&':
 		    advance();
 		    if (now() == '&') {
 			advance();
-			tokens.push_back(Token(TokenKind::AND, "&&",
-			Span(filename.c_str(), line, sc, column - 1)));
+			tokens.push(TokenKind::AND, sc, pos - sc);
 			break;
 		    }
-		    tokens.push_back(Token(TokenKind::BAND, "&",
-                    Span(filename.c_str(), line, sc, column - 1)));
+		    tokens.push(TokenKind::BAND, sc, pos - sc);
+		    break;
 		case ':':
 		    advance();
-		    tokens.push_back(Token(TokenKind::COLON, ":",
-                    Span(filename.c_str(), line, sc, column - 1)));
+		    tokens.push(TokenKind::COLON, sc, pos - sc);
 		    break;
 		case ',':
 		    advance();
-		    tokens.push_back(Token(TokenKind::COMMA, ".",
-                    Span(filename.c_str(), line, sc, column - 1)));
+		    tokens.push(TokenKind::COMMA, sc, pos - sc);
 		    break;
 		case '(':
 		    advance();
-		    tokens.push_back(Token(TokenKind::OPEN_PAREN, "(",
-                    Span(filename.c_str(), line, sc, column - 1)));
+		    tokens.push(TokenKind::OPEN_PAREN, sc, pos - sc);
 		    break;
 		case ')':
 		    advance();
-		    tokens.push_back(Token(TokenKind::CLOSE_PAREN, ")",
-                    Span(filename.c_str(), line, sc, column - 1)));
+		    tokens.push(TokenKind::CLOSE_PAREN, sc, pos - sc);
 		    break;
 		case ';':
 		    advance();
-		    tokens.push_back(Token(TokenKind::SEMI, ";",
-                    Span(filename.c_str(), line, sc, column - 1)));
+		    tokens.push(TokenKind::SEMI, sc, pos - sc);
 		    break;
 		default:
 		    std::stringstream s;
 		    s << "Unexpected char: '" << now() << "'\n";
-		    error_manager->report(Diagnostic(DiagnosticType::Error, Span(filename.c_str(), line, column-2, column-1), s.str(), ""), true);
+		    error_manager->report(Diagnostic(DiagnosticType::Error, Span(file, pos, 1), s.str(), ""), true);
 		    exit(1);
 		}
 	    }
-	    tokens.push_back(Token(TokenKind::TEOF, "EOF",
-            Span(filename.c_str(), line, column, column)));
+	    tokens.push(TokenKind::TEOF, pos, 0);
 	    return tokens;
 	}
     } // namespace Language
@@ -1,25 +1,180 @@
+#include <ast_dump.hpp>
+#include <cache.hpp>
+#include <compiler.hpp>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <iostream>
 #include <lexer.hpp>
+#include <module.hpp>
+#include <optimizer.hpp>
 #include <parser.hpp>
+#include <resolver.hpp>
+#include <unistd.h>
 #include <value.hpp>
 #include <vm.hpp>
 extern void print_usage(const char *program) {
-  std::cout << "Usage: " << program << " <filename>\n";
+  std::cout << "Usage: " << program << " [options] <filename>\n";
+  std::cout << "Options:\n";
+  std::cout << "  --tree-walk    evaluate the AST directly instead of compiling to bytecode\n";
+  std::cout << "  --no-opt       skip constant folding and dead-branch elimination\n";
+  std::cout << "  --no-jit       never compile hot loops to native code\n";
+  std::cout << "  --no-cache     always compile from source; don't read or write .tspc files\n";
+  std::cout << "  --dump-ast     print the AST after optimization and exit\n";
+  std::cout << "  --flush=POLICY when to write buffered output: size, newline or exit\n";
+  std::cout << "                 (default: newline on a terminal, size otherwise)\n";
+  std::cout << "  --unbuffered   write output after every print call\n";
+  std::cout << "  --gc-stats     print garbage collector statistics to stderr on exit\n";
+  std::cout << "  --stats[=FILE] print allocation, evaluation, lookup and builtin counters and peak\n";
+  std::cout << "                 RSS to stderr on exit, or write them to FILE as JSON\n";
+  std::cout << "  --profile[=FILE]\n";
+  std::cout << "                 sample where time goes: print the hottest lines to stderr and\n";
+  std::cout << "                 write folded stacks to FILE (default: <filename>.folded)\n";
+}
+
+// Set while --profile is on. Also run from exit(), so a script that fails or
+// calls exit() still gets its profile.
+static std::function<void()> finish_profile;
+
+static void write_profile() {
+  if (finish_profile) {
+    auto finish = std::move(finish_profile);
+    finish_profile = nullptr;
+    finish();
+  }
 }
 
 int main(int argc, char **argv) {
-  if (argc < 2) {
+  std::string filename;
+  bool tree_walk = false;
+  bool optimize  = true;
+  bool dump_ast  = false;
+  bool gc_stats  = false;
+  bool jit       = true;
+  bool use_cache = true;
+  bool profile   = false;
+  bool runtime_stats = false;
+  std::string stats_path;
+  std::string profile_path;
+  auto flush     = isatty(1) ? Tisp::Runtime::FlushPolicy::Newline : Tisp::Runtime::FlushPolicy::Size;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--tree-walk") == 0) {
+      tree_walk = true;
+    } else if (strcmp(argv[i], "--no-opt") == 0) {
+      optimize = false;
+    } else if (strcmp(argv[i], "--no-jit") == 0) {
+      jit = false;
+    } else if (strcmp(argv[i], "--no-cache") == 0) {
+      use_cache = false;
+    } else if (strcmp(argv[i], "--dump-ast") == 0) {
+      dump_ast = true;
+    } else if (strcmp(argv[i], "--flush=size") == 0) {
+      flush = Tisp::Runtime::FlushPolicy::Size;
+    } else if (strcmp(argv[i], "--flush=newline") == 0) {
+      flush = Tisp::Runtime::FlushPolicy::Newline;
+    } else if (strcmp(argv[i], "--flush=exit") == 0) {
+      flush = Tisp::Runtime::FlushPolicy::Exit;
+    } else if (strcmp(argv[i], "--gc-stats") == 0) {
+      gc_stats = true;
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      runtime_stats = true;
+    } else if (strncmp(argv[i], "--stats=", 8) == 0) {
+      runtime_stats = true;
+      stats_path = argv[i] + 8;
+    } else if (strcmp(argv[i], "--profile") == 0) {
+      profile = true;
+    } else if (strncmp(argv[i], "--profile=", 10) == 0) {
+      profile = true;
+      profile_path = argv[i] + 10;
+    } else if (strcmp(argv[i], "--unbuffered") == 0) {
+      flush = Tisp::Runtime::FlushPolicy::Unbuffered;
+    } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+      std::cout << "Unknown option '" << argv[i] << "'\n";
+      print_usage(argv[0]);
+      exit(1);
+    } else {
+      filename = argv[i];
+    }
+  }
+  if (filename.empty()) {
     print_usage(argv[0]);
     exit(1);
   }
-  std::string filename = argv[1];
-  Tisp::Language::Lexer Lexer = Tisp::Language::Lexer(filename);
-  ErrorManager error_manager  = ErrorManager(Lexer.source);
-  Lexer.error_manager = &error_manager;
-  Tisp::Language::Tokens tokens = Lexer.parse();
-  Tisp::Language::Parser parser = Tisp::Language::Parser(tokens, &error_manager);
-  auto p = parser.parse();
+  Tisp::SourceManager sources;
+  int file = sources.load(filename);
+  if (file < 0) {
+    std::cout << "Unable to open '" << filename << "' : No Such file or directory\n";
+    exit(1);
+  }
+  ErrorManager error_manager  = ErrorManager(&sources);
+  // A cache hit only carries bytecode, so the tree-walker and --dump-ast
+  // always start from the source.
+  use_cache = use_cache && !tree_walk && !dump_ast;
+  Tisp::Runtime::ScriptCache cache = Tisp::Runtime::ScriptCache(filename, sources.text(file), optimize);
+  bool cached = use_cache && cache.load(sources, file);
+  Tisp::Language::Node p;
+  if (cached) {
+    p.frame_size = cache.frame_size;
+  } else {
+    Tisp::Language::ModuleLoader loader = Tisp::Language::ModuleLoader(&sources, &error_manager);
+    p = loader.load(file);
+    Tisp::Language::Resolver resolver = Tisp::Language::Resolver(&error_manager);
+    resolver.resolve(p);
+    if (optimize) {
+      Tisp::Language::Optimizer optimizer = Tisp::Language::Optimizer(*p.arena);
+      optimizer.optimize(p);
+    }
+    if (dump_ast) {
+      Tisp::Language::dump_ast(p, std::cout);
+      return 0;
+    }
+  }
   Tisp::Runtime::Vm vm = Tisp::Runtime::Vm(std::move(p), &error_manager);
-  vm.execute();
+  vm.out.policy = flush;
+  vm.jit.enabled = jit;
+  vm.stats.enabled = runtime_stats;
+  Tisp::Runtime::Profiler profiler;
+  if (profile) {
+    if (profile_path.empty()) {
+      profile_path = filename + ".folded";
+    }
+    vm.profiler = &profiler;
+    finish_profile = [&] {
+      profiler.stop();
+      profiler.write_lines(sources, std::cerr);
+      std::ofstream folded(profile_path);
+      profiler.write_folded(sources, folded);
+      std::cerr << "profile: folded stacks written to " << profile_path << "\n";
+    };
+    std::atexit(write_profile);
+    profiler.start();
+  }
+  if (tree_walk) {
+    vm.execute();
+  } else {
+    Tisp::Runtime::Compiler compiler = Tisp::Runtime::Compiler(&error_manager);
+    Tisp::Runtime::Chunk chunk = cached ? std::move(cache.chunk) : compiler.compile(vm.program);
+    // Warnings are only reported while compiling, so don't cache past them.
+    if (use_cache && !cached && error_manager.errors.empty()) {
+      cache.store(chunk, vm.program.frame_size, sources, file);
+    }
+    vm.run(chunk);
+  }
+  vm.out.flush();
+  write_profile();
+  if (gc_stats) {
+    auto& stats = vm.heap.stats;
+    std::cerr << "gc: " << stats.collections << " collections, "
+              << stats.freed_objects << " objects (" << stats.freed_bytes << " bytes) freed, "
+              << vm.heap.bytes_allocated << " bytes live, "
+              << stats.peak_bytes << " bytes peak, "
+              << stats.pause_ms << " ms paused\n";
+  }
+  if (runtime_stats && stats_path.empty()) {
+    vm.write_stats(std::cerr, false);
+  } else if (runtime_stats) {
+    std::ofstream json(stats_path);
+    vm.write_stats(json, true);
+  }
   error_manager.reportAll();
 }
@@ -0,0 +1,126 @@
+#include <filesystem>
+#include <module.hpp>
+#include <optional>
+
+namespace Tisp {
+    namespace Language {
+	namespace {
+	    // The key a file is known by, so "a/../b.tsp" and "b.tsp" are one
+	    // module. In-memory scripts have no file and keep their name.
+	    std::string canonical(const std::filesystem::path& path) {
+		std::error_code error;
+		auto            real = std::filesystem::weakly_canonical(path, error);
+		return error ? path.string() : real.string();
+	    }
+	}
+
+	ModuleLoader::Module* ModuleLoader::add(std::string path, int file) {
+	    auto module  = std::make_unique<Module>();
+	    module->path = path;
+	    module->file = file;
+	    Module* m    = module.get();
+	    modules.emplace(std::move(path), std::move(module));
+	    return m;
+	}
+
+	Node ModuleLoader::load(int root) {
+	    Module*              main  = add(canonical(std::string(sources->name(root))), root);
+	    std::vector<Module*> batch = {main};
+	    while (!batch.empty()) {
+		parse_all(batch);
+		std::vector<Module*> next;
+		for (Module* module : batch) {
+		    auto dir = std::filesystem::path(sources->name(module->file)).parent_path();
+		    for (auto& import : module->ast.imports) {
+			std::string name = (dir / import.path).lexically_normal().string();
+			std::string key  = canonical(name);
+			auto        it   = modules.find(key);
+			if (it != modules.end()) {
+			    module->imports.push_back(it->second.get());
+			    continue;
+			}
+			int file = sources->load(name);
+			if (file < 0) {
+			    std::stringstream s;
+			    s << "Module Not Found: '" << import.path << "'";
+			    error_manager->report(Diagnostic(DiagnosticType::Error, import.span, s.str(), ""), true);
+			}
+			Module* imported = add(key, file);
+			module->imports.push_back(imported);
+			next.push_back(imported);
+		    }
+		}
+		batch = std::move(next);
+	    }
+	    if (main->imports.empty()) {
+		return std::move(main->ast);
+	    }
+
+	    Node program;
+	    program.arena   = std::move(main->ast.arena);
+	    program.imports = std::move(main->ast.imports);
+	    std::vector<Stmtptr> stmts;
+	    merge(main, stmts, program);
+	    NodeBody* merged    = program.arena->make<NodeBody>();
+	    merged->span        = std::get<NodeBody*>(main->ast.stmt->stmt)->span;
+	    merged->stmts.items = program.arena->copy_array(stmts.data(), stmts.size());
+	    merged->stmts.count = stmts.size();
+	    program.stmt        = program.arena->make<NodeStmt>(main->ast.stmt->span, StmtKind::Body, merged);
+	    return program;
+	}
+
+	// Every file of one depth is independent of the others, so they are
+	// lexed and parsed at once. Each gets its own ErrorManager; diagnostics
+	// are then handed over in file order, keeping the output deterministic.
+	void ModuleLoader::parse_all(const std::vector<Module*>& batch) {
+	    std::vector<std::optional<Diagnostic>> failures(batch.size());
+	    auto parse = [&](size_t task, size_t) {
+		Module*      module = batch[task];
+		ErrorManager errors(sources);
+		errors.throw_errors = true;
+		try {
+		    Lexer lexer(sources, module->file);
+		    lexer.error_manager = &errors;
+		    Tokens tokens       = lexer.parse();
+		    Parser parser(tokens, &errors);
+		    module->ast = parser.parse();
+		} catch (DiagnosticError& error) {
+		    failures[task] = std::move(error.diagnostic);
+		}
+		module->diagnostics = std::move(errors.errors);
+	    };
+	    if (batch.size() == 1) {
+		parse(0, 0);
+	    } else {
+		if (!scheduler) {
+		    scheduler = std::make_unique<Runtime::Scheduler>(Runtime::Scheduler::default_workers());
+		}
+		scheduler->run(batch.size(), parse);
+	    }
+	    for (size_t i = 0; i < batch.size(); i++) {
+		auto& diagnostics = batch[i]->diagnostics;
+		error_manager->errors.insert(error_manager->errors.end(), diagnostics.begin(), diagnostics.end());
+		diagnostics.clear();
+		if (failures[i]) {
+		    error_manager->report(*failures[i], true);
+		}
+	    }
+	}
+
+	// Post-order, so a module's top level runs after everything it imports.
+	// A module is marked before its imports are visited, which ends cycles.
+	void ModuleLoader::merge(Module* module, std::vector<Stmtptr>& stmts, Node& program) {
+	    module->merged = true;
+	    for (Module* imported : module->imports) {
+		if (!imported->merged) {
+		    merge(imported, stmts, program);
+		}
+	    }
+	    auto body = std::get<NodeBody*>(module->ast.stmt->stmt);
+	    stmts.insert(stmts.end(), body->stmts.begin(), body->stmts.end());
+	    if (module->ast.arena) {
+		program.module_arenas.push_back(std::move(module->ast.arena));
+	    }
+	}
+    } // namespace Language
+} // namespace Tisp
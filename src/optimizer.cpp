@@ -0,0 +1,148 @@
+#include <optimizer.hpp>
+
+namespace Tisp {
+    namespace Language {
+	void Optimizer::optimize(Node& program) {
+	    optimize_body(std::get<NodeBody*>(program.stmt->stmt));
+	}
+
+	void Optimizer::optimize_body(NodeBody* body) {
+	    for (auto stmt : body->stmts) {
+		switch (stmt->kind) {
+		case StmtKind::Assignment: {
+		    auto node  = std::get<NodeAssignment*>(stmt->stmt);
+		    node->expr = optimize_expr(node->expr);
+		} break;
+		case StmtKind::Expr: {
+		    auto node  = std::get<NodeExprStmt*>(stmt->stmt);
+		    node->expr = optimize_expr(node->expr);
+		} break;
+		case StmtKind::Function:
+		    optimize_body(std::get<NodeFunction*>(stmt->stmt)->body);
+		    break;
+		case StmtKind::Return: {
+		    auto node = std::get<NodeReturn*>(stmt->stmt);
+		    if (node->value) {
+			node->value = optimize_expr(node->value);
+		    }
+		} break;
+		default:
+		    break;
+		}
+	    }
+	}
+
+	Exprptr Optimizer::optimize_expr(Exprptr expr) {
+	    switch (expr->kind) {
+	    case ExprKind::Bin: {
+		// Operator chains are left-deep; walk the left spine instead of recursing.
+		size_t    mark = spine.size();
+		NodeExpr* left = expr;
+		while (left->kind == ExprKind::Bin) {
+		    spine.push_back(static_cast<NodeBin*>(left));
+		    left = static_cast<NodeBin*>(left)->lhs;
+		}
+		Exprptr acc = optimize_expr(left);
+		while (spine.size() > mark) {
+		    NodeBin* nbin = spine.back();
+		    spine.pop_back();
+		    acc = fold_binary(nbin, acc, optimize_expr(nbin->rhs));
+		}
+		return acc;
+	    }
+	    case ExprKind::Call: {
+		auto ncall = static_cast<NodeCall*>(expr);
+		for (auto& arg : ncall->args) {
+		    arg = optimize_expr(arg);
+		}
+	    } break;
+	    case ExprKind::If: {
+		auto nif       = static_cast<NodeIf*>(expr);
+		nif->condition = optimize_expr(nif->condition);
+		optimize_body(nif->then_body);
+		if (nif->else_body) {
+		    optimize_body(nif->else_body);
+		}
+		if (nif->condition->kind == ExprKind::Int) {
+		    // The `if` still evaluates to its condition.
+		    NodeBody* taken = static_cast<NodeInt*>(nif->condition)->value > 0 ? nif->then_body : nif->else_body;
+		    if (!taken || taken->stmts.empty()) {
+			return nif->condition;
+		    }
+		    return arena.make<NodeBlock>(taken, nif->condition, nif->span);
+		}
+	    } break;
+	    case ExprKind::Loop: {
+		auto nloop   = static_cast<NodeLoop*>(expr);
+		nloop->times = optimize_expr(nloop->times);
+		optimize_body(nloop->body);
+		if (nloop->times->kind == ExprKind::Int && static_cast<NodeInt*>(nloop->times)->value <= 0) {
+		    return nloop->times;
+		}
+	    } break;
+	    case ExprKind::Block: {
+		auto nblock   = static_cast<NodeBlock*>(expr);
+		optimize_body(nblock->body);
+		nblock->value = optimize_expr(nblock->value);
+	    } break;
+	    default:
+		break;
+	    }
+	    return expr;
+	}
+
+	Exprptr Optimizer::fold_binary(NodeBin* node, Exprptr lhs, Exprptr rhs) {
+	    node->lhs = lhs;
+	    node->rhs = rhs;
+	    if (lhs->kind != ExprKind::Int) {
+		return node;
+	    }
+	    int64_t a = static_cast<NodeInt*>(lhs)->value;
+	    // && and || short-circuit, so a constant left side decides them alone.
+	    if (node->op == BinaryOp::And && a == 0) return arena.make<NodeInt>(0, node->span);
+	    if (node->op == BinaryOp::Or && a != 0)  return arena.make<NodeInt>(1, node->span);
+	    if (rhs->kind != ExprKind::Int) {
+		return node;
+	    }
+	    int64_t b = static_cast<NodeInt*>(rhs)->value;
+	    int64_t r;
+	    switch (node->op) {
+	    // Anything that overflows, traps or loses bits is left unfolded,
+	    // for the run-time check to report.
+	    case BinaryOp::Add:
+		if (__builtin_add_overflow(a, b, &r)) return node;
+		break;
+	    case BinaryOp::Sub:
+		if (__builtin_sub_overflow(a, b, &r)) return node;
+		break;
+	    case BinaryOp::Mul:
+		if (__builtin_mul_overflow(a, b, &r)) return node;
+		break;
+	    case BinaryOp::Div:
+	    case BinaryOp::Mod:
+		if (b == 0 || (b == -1 && a == INT64_MIN)) return node;
+		r = node->op == BinaryOp::Div ? a / b : a % b;
+		break;
+	    case BinaryOp::Shl:
+		if (b < 0 || b > 63 || ((a << b) >> b) != a) return node;
+		r = a << b;
+		break;
+	    case BinaryOp::Shr:
+		if (b < 0 || b > 63) return node;
+		r = a >> b;
+		break;
+	    case BinaryOp::And:  r = a && b; break;
+	    case BinaryOp::Or:   r = a || b; break;
+	    case BinaryOp::Band: r = a & b; break;
+	    case BinaryOp::Bor:  r = a | b; break;
+	    case BinaryOp::Lt:   r = a < b; break;
+	    case BinaryOp::Le:   r = a <= b; break;
+	    case BinaryOp::Gt:   r = a > b; break;
+	    case BinaryOp::Ge:   r = a >= b; break;
+	    case BinaryOp::Eq:   r = a == b; break;
+	    case BinaryOp::Ne:   r = a != b; break;
+	    }
+	    return arena.make<NodeInt>(r, node->span);
+	}
+    } // namespace Language
+} // namespace Tisp
@@ -0,0 +1,86 @@
+#include <charconv>
+#include <cstdlib>
+#include <errno.h>
+#include <mutex>
+#include <output.hpp>
+#include <unistd.h>
+
+namespace Tisp {
+    namespace Runtime {
+	// Buffers still alive when exit() runs, e.g. after a fatal diagnostic.
+	// Vms may be created on several threads at once, hence the lock.
+	static std::vector<Output*> live_outputs;
+	static std::mutex           live_outputs_lock;
+
+	static void flush_live_outputs() {
+	    std::lock_guard<std::mutex> guard(live_outputs_lock);
+	    for (Output* out : live_outputs) {
+		out->flush();
+	    }
+	}
+
+	Output::Output() {
+	    static bool registered = (std::atexit(flush_live_outputs), true);
+	    (void)registered;
+	    buffer.reserve(limit);
+	    std::lock_guard<std::mutex> guard(live_outputs_lock);
+	    live_outputs.push_back(this);
+	}
+
+	Output::~Output() {
+	    flush();
+	    std::lock_guard<std::mutex> guard(live_outputs_lock);
+	    std::erase(live_outputs, this);
+	}
+
+	void Output::write(std::string_view text) {
+	    buffer.insert(buffer.end(), text.begin(), text.end());
+	    if (policy != FlushPolicy::Exit && buffer.size() >= limit) {
+		flush();
+	    }
+	}
+
+	void Output::write_int(int64_t value) {
+	    char digits[24];
+	    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+	    write(std::string_view(digits, result.ptr - digits));
+	}
+
+	void Output::write_value(Value::Value value) {
+	    switch (value.kind()) {
+	    case Value::ValueKind::Number:
+		write_int(value.as_int());
+		break;
+	    case Value::ValueKind::String:
+		write(value.as_string());
+		break;
+	    default:
+		break;
+	    }
+	}
+
+	void Output::end_print(bool newline) {
+	    if (policy == FlushPolicy::Unbuffered || (newline && policy == FlushPolicy::Newline)) {
+		flush();
+	    }
+	}
+
+	void Output::flush() {
+	    if (sink) {
+		sink->append(buffer.data(), buffer.size());
+		buffer.clear();
+		return;
+	    }
+	    size_t done = 0;
+	    while (done < buffer.size()) {
+		ssize_t n = ::write(fd, buffer.data() + done, buffer.size() - done);
+		if (n < 0) {
+		    if (errno == EINTR) continue;
+		    break;
+		}
+		done += n;
+	    }
+	    buffer.clear();
+	}
+    } // namespace Runtime
+} // namespace Tisp
@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <atomic>
+#include <optional>
+#include <vm.hpp>
+
+namespace Tisp {
+    namespace Runtime {
+	Value::Value Vm::import_value(Value::Value value) {
+	    if (!value.is_obj()) {
+		return value;
+	    }
+	    switch (value.as_obj()->kind) {
+	    case Value::ObjKind::Int:
+		return heap.make_int(value.as_int());
+	    case Value::ObjKind::String:
+		return heap.intern(value.as_string());
+	    case Value::ObjKind::Error:
+		return heap.make_error(std::string(value.as_string()));
+	    }
+	    return Value::Value::nil();
+	}
+
+	void Vm::run_iterations(LoopBody body, int64_t begin, int64_t end, const std::vector<Value::Value>& frame) {
+	    size_t mark = pinned.size();
+	    pinned.insert(pinned.end(), frame.begin(), frame.end());
+	    for (int64_t i = begin; i < end; i++) {
+		size_t base = stack.size();
+		stack.insert(stack.end(), frame.begin(), frame.end());
+		stack[base] = heap.make_int(i);
+		if (body.chunk) {
+		    // The byte before the entry is a Halt, so the body's Return
+		    // ends this run().
+		    frames.push_back(Frame{body.entry - 1, base});
+		    run(*body.chunk, body.entry, base);
+		} else {
+		    size_t saved = bp;
+		    bp           = base;
+		    execute_body(body.loop->body);
+		    bp = saved;
+		}
+		stack.resize(base);
+	    }
+	    pinned.resize(mark);
+	}
+
+	void Vm::parallel_loop(LoopBody body, int64_t times, const std::vector<Value::Value>& frame) {
+	    if (times <= 0) {
+		return;
+	    }
+	    if (!worker && !scheduler) {
+		scheduler = std::make_unique<Scheduler>(Scheduler::default_workers());
+	    }
+	    if (worker || scheduler->workers == 1) {
+		run_iterations(body, 0, times, frame);
+		return;
+	    }
+	    // Workers format their diagnostics; build every line table now so
+	    // that the shared SourceManager is only read from here on.
+	    Tisp::SourceManager* sources = error_manager->sources;
+	    for (size_t file = 0; file < sources->files.size(); file++) {
+		sources->locate(file, 0);
+	    }
+	    size_t n = scheduler->workers;
+	    while (workers.size() < n) {
+		workers.push_back(std::make_unique<ParallelWorker>(sources));
+	    }
+
+	    // A few tasks per worker leave room for stealing to even out
+	    // iterations of different cost.
+	    size_t                   tasks = std::min<uint64_t>(times, n * 16);
+	    int64_t                  share = times / tasks;
+	    int64_t                  extra = times % tasks;
+	    std::vector<std::string> outputs(tasks);
+	    std::vector<uint8_t>     ready(n, 0);
+	    std::atomic<size_t>      failed_task = SIZE_MAX;
+	    std::mutex               failure_lock;
+	    std::optional<Diagnostic> failure;
+
+	    scheduler->run(tasks, [&](size_t task, size_t w) {
+		// Everything before the first failure still runs, so the output
+		// is what a sequential loop would have printed before stopping.
+		if (task > failed_task.load(std::memory_order_relaxed)) {
+		    return;
+		}
+		ParallelWorker& pw = *workers[w];
+		if (!ready[w]) {
+		    if (!pw.vm) {
+			Language::Node view;
+			view.functions     = program.functions;
+			view.frame_size    = env.slots.size();
+			pw.vm              = std::make_unique<Vm>(std::move(view), &pw.errors);
+			pw.vm->worker      = true;
+			pw.vm->jit.enabled = jit.enabled;
+			pw.vm->profiler    = profiler;
+			pw.vm->stats.enabled = stats.enabled;
+		    }
+		    // Outer variables are snapshots: nothing can assign them
+		    // while the loop runs, so the copies stay accurate.
+		    Vm& vm = *pw.vm;
+		    vm.env.slots.resize(env.slots.size());
+		    for (size_t i = 0; i < env.slots.size(); i++) {
+			vm.env.slots[i] = vm.import_value(env.slots[i]);
+		    }
+		    pw.frame.clear();
+		    for (auto value : frame) {
+			pw.frame.push_back(vm.import_value(value));
+		    }
+		    if (body.chunk && pw.forked_from != body.chunk) {
+			pw.chunk = std::make_unique<Chunk>(body.chunk->fork());
+			// Compiled loops belong to this Vm's Jit; the copy
+			// starts from plain LoopTests.
+			for (auto& [at, loop] : jit.loops) {
+			    if (loop.fn) pw.chunk->code[at - body.chunk->code.data()] = uint8_t(OpCode::LoopTest);
+			}
+			pw.forked_from = body.chunk;
+		    }
+		    ready[w] = 1;
+		}
+		Vm&      vm    = *pw.vm;
+		LoopBody local = body;
+		if (body.chunk) {
+		    local.chunk = pw.chunk.get();
+		}
+		int64_t begin = task * share + std::min<int64_t>(task, extra);
+		int64_t end   = begin + share + (int64_t(task) < extra);
+		vm.out.sink   = &outputs[task];
+		try {
+		    vm.run_iterations(local, begin, end, pw.frame);
+		} catch (DiagnosticError& error) {
+		    vm.stack.clear();
+		    vm.frames.clear();
+		    vm.pinned.clear();
+		    vm.bp = 0;
+		    std::lock_guard<std::mutex> guard(failure_lock);
+		    if (task < failed_task) {
+			failed_task = task;
+			failure     = error.diagnostic;
+		    }
+		}
+		vm.out.flush();
+		vm.out.sink = nullptr;
+	    });
+
+	    for (size_t task = 0; task < tasks && task <= failed_task; task++) {
+		out.write(outputs[task]);
+	    }
+	    out.end_print(true);
+	    if (failure) {
+		out.flush();
+		error_manager->report(*failure, true);
+	    }
+	}
+    } // namespace Runtime
+} // namespace Tisp
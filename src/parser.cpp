@@ -1,5 +1,7 @@
 #include "lexer.hpp"
+#include <array>
 #include <cassert>
+#include <charconv>
 #include <cstdio>
 #include <iostream>
 #include <memory>
@@ -8,280 +10,327 @@
 
 namespace Tisp {
     namespace Language {
-	using std::make_unique;
-
-	Token Parser::peek() {
-	    if (pos + 1 >= source.size()) {
-		// last Token is always EOF
-		return source.at(source.size() - 1);
-	    }
-	    return source.at(pos + 1);
-	}
-	Token Parser::now() {
-	    if (pos >= source.size()) {
-		return source.at(source.size() - 1);
-	    }
-	    return source.at(pos);
-	}
-	Token Parser::before() {
-	    if (pos - 1 >= source.size()) {
-		return source.at(source.size() - 1);
-	    }
-	    return source.at(pos - 1);
-	}
-	void Parser::advance() { pos++; }
 	Node Parser::parse() {
-	    NodeBody* body = new NodeBody();
-	    Node program;
-	    while (now().kind != TokenKind::TEOF) {
-		switch (now().kind) {
-		case Tisp::Language::TokenKind::KEYWORD: {
-		    if (now().data == "func") {
-			Node func_stmt = parse_func();
-		    } else
-		    if (now().data == "let") {
-			advance();
-			auto span = now().span;
-			const char *name = strdup(now().data.c_str());
-			advance();
-			expect(TokenKind::EQ);
-			auto expr = parse_expr();
-			expect(TokenKind::SEMI);
-			std::unique_ptr<NodeStmt> stmt = std::make_unique<NodeStmt>(
-			span, StmtKind::Assignment,
-			new NodeAssignment(
-			NodeAssignment(name, std::move(expr), span)));
-			if (!stmt) {
-			    printf("Stmt if null\n");
-			}
-			body->stmts.push_back(std::move(stmt));
-		    } else {
-			auto expr = parse_expr();
-			auto exprs = new NodeExprStmt(std::move(expr));
-			auto stmt = std::make_unique<NodeStmt>(now().span, StmtKind::Expr,
-			exprs);
-			body->stmts.push_back(std::move(stmt));
-		    }
-		} break;
-	    default:
-		auto expr = parse_expr();
-		expect(TokenKind::SEMI);
-		auto exprs = new NodeExprStmt(std::move(expr));
-		body->stmts.push_back(std::make_unique<NodeStmt>(now().span, StmtKind::Expr, exprs));
-		break;
+	    Node   program;
+	    size_t mark = stmt_scratch.size();
+	    while (now_kind() != TokenKind::TEOF) {
+		if (now_kind() == TokenKind::KEYWORD && now_text() == "import") {
+		    parse_import();
+		    continue;
+		}
+		stmt_scratch.push_back(parse_stmt(true));
 	    }
-	}
-	program.stmt = std::make_unique<NodeStmt>(now().span, StmtKind::Body, body);
+	NodeBody* body = finish_body(mark, now_span());
+	program.stmt    = arena->make<NodeStmt>(now_span(), StmtKind::Body, body);
+	program.arena   = std::move(arena);
+	program.imports = std::move(imports);
 	return program;
     }
 
-    Node Parser::parse_func() {
-	Node n;
+    void Parser::parse_import() {
+	advance();
+	if (match(TokenKind::NAME)) {
+	    imports.push_back(Import{std::string(now_text()) + ".tsp", now_span()});
+	} else if (match(TokenKind::STRING)) {
+	    imports.push_back(Import{std::string(now_text()), now_span()});
+	} else {
+	    error_manager->report(Diagnostic(DiagnosticType::Error, now_span(), "Expected a module name or path", ""), true);
+	}
+	advance();
+	expect(TokenKind::SEMI);
+    }
+
+    Stmtptr Parser::parse_func() {
+	Span span = now_span();
 	advance();
-	std::unique_ptr<NodeFunction> fn;
+	const char* name = nullptr;
 	if (match(TokenKind::NAME)) {
-	    fn->name = strdup(now().data.c_str());
+	    name = arena->intern(now_text());
 	    advance();
 	} else {
 	    std::stringstream s;
 	    s << "Expected a name\n";
-	    error_manager->report(Diagnostic(DiagnosticType::Error, now().span, s.str(), ""), true);
+	    error_manager->report(Diagnostic(DiagnosticType::Error, now_span(), s.str(), ""), true);
+	}
+	// Parameters are optional: `func name: ... end` takes none.
+	NodeList<const char*> params;
+	if (match(TokenKind::OPEN_PAREN)) {
+	    advance();
+	    std::vector<const char*> names;
+	    while (!match(TokenKind::CLOSE_PAREN)) {
+		if (!match(TokenKind::NAME)) {
+		    error_manager->report(Diagnostic(DiagnosticType::Error, now_span(), "Expected a parameter name", ""), true);
+		}
+		names.push_back(arena->intern(now_text()));
+		advance();
+		if (!match(TokenKind::COMMA)) break;
+		advance();
+	    }
+	    expect(TokenKind::CLOSE_PAREN);
+	    params.items = arena->copy_array(names.data(), names.size());
+	    params.count = names.size();
 	}
 	expect(TokenKind::COLON);
-	fn->body = parse_body();
-	n.stmt = std::make_unique<NodeStmt>();
-	n.stmt->stmt = fn.get();
-	return n;
+	NodeBody* body = parse_body();
+	expect_kw("end");
+	auto fn = arena->make<NodeFunction>(name, params, body, span);
+	return arena->make<NodeStmt>(span, StmtKind::Function, fn);
     }
 
-    std::unique_ptr<NodeBody> Parser::parse_body() {
-	std::unique_ptr<NodeBody> b = std::make_unique<NodeBody>();
-    // TODO:
-	while (!(now().kind == TokenKind::KEYWORD && now().data == "end" || now().data == "else")) {
-	    switch (now().kind) {
-	    case Tisp::Language::TokenKind::KEYWORD: {
-		if (now().data == "func") {
-		    Node func_stmt = parse_func();
-		} else
-		if (now().data == "let") {
-		    advance();
-		    auto span = now().span;
-		    const char *name = strdup(now().data.c_str());
-		    advance();
-		    expect(TokenKind::EQ);
-		    auto expr = parse_expr();
-		    expect(TokenKind::SEMI);
-		    std::unique_ptr<NodeStmt> stmt = std::make_unique<NodeStmt>(span, StmtKind::Assignment, new NodeAssignment(name, std::move(expr), span));
-		    if (!stmt) {
-			printf("Stmt is null\n");
-		    }
-		    b->stmts.push_back(std::move(stmt));
-		} else {
-		    std::stringstream s;
-		    s << "Invalid Statememt: '" << now().data << "' \n";
-		    error_manager->report(Diagnostic(DiagnosticType::Error, now().span, s.str(), ""), true);		    
-		    exit(1);
-		}
-	    } break;
-	    default: {
-		auto expr = parse_expr();
-		expect(TokenKind::SEMI);
-		auto exprs = new NodeExprStmt(std::move(expr));
-		auto stmt = std::make_unique<NodeStmt>(now().span, StmtKind::Expr, exprs);
-		b->stmts.push_back(std::move(stmt));
-	    } break;
+    Stmtptr Parser::parse_return() {
+	Span    span  = now_span();
+	advance();
+	Exprptr value = nullptr;
+	if (!match(TokenKind::SEMI)) {
+	    value = parse_expr();
 	}
+	expect(TokenKind::SEMI);
+	return arena->make<NodeStmt>(span, StmtKind::Return, arena->make<NodeReturn>(value, span));
     }
-    return b;
-}
 
-Exprptr Parser::parse_expr() {
-    return parse_logical_or();
-}
-
-Exprptr Parser::parse_logical_or() {
-    Span    span = now().span;
-    Exprptr lhs  = parse_logical_and();
-    while (match(TokenKind::OR)) {
-	auto op = BinaryOp::Or;
-	advance();
-	Exprptr rhs  = parse_logical_or();
-	Exprptr node = std::make_unique<NodeBin>(op, std::move(lhs), std::move(rhs), span);
-	lhs          = std::move(node);
+    Stmtptr Parser::parse_stmt(bool top_level) {
+	Span span = now_span();
+	if (now_kind() == TokenKind::KEYWORD) {
+	    if (now_text() == "func") {
+		if (!top_level) {
+		    error_manager->report(Diagnostic(DiagnosticType::Error, span, "Functions can only be defined at the top level", ""), true);
+		}
+		return parse_func();
+	    }
+	    if (now_text() == "import") {
+		error_manager->report(Diagnostic(DiagnosticType::Error, span, "Modules can only be imported at the top level", ""), true);
+	    }
+	    if (now_text() == "let") {
+		return parse_let();
+	    }
+	    if (now_text() == "return") {
+		return parse_return();
+	    }
+	    // `if`, `loop` and `ploop` are closed by `end` and take no semicolon.
+	    auto expr = parse_expr();
+	    return arena->make<NodeStmt>(span, StmtKind::Expr, arena->make<NodeExprStmt>(expr));
+	}
+	auto expr = parse_expr();
+	expect(TokenKind::SEMI);
+	return arena->make<NodeStmt>(span, StmtKind::Expr, arena->make<NodeExprStmt>(expr));
     }
-    return lhs;
-}
 
-Exprptr Parser::parse_logical_and() {
-    Span    span = now().span;
-    Exprptr lhs = parse_additive();
-    while (match(TokenKind::AND)) {
-	auto op = BinaryOp::And;
+    Stmtptr Parser::parse_let() {
+	advance();
+	auto span = now_span();
+	const char *name = arena->intern(now_text());
 	advance();
-	Exprptr rhs  = parse_logical_or();
-	Exprptr node = std::make_unique<NodeBin>(op, std::move(lhs), std::move(rhs), span);
-	lhs          = std::move(node);
+	expect(TokenKind::EQ);
+	auto expr = parse_expr();
+	expect(TokenKind::SEMI);
+	return arena->make<NodeStmt>(span, StmtKind::Assignment, arena->make<NodeAssignment>(name, expr, span));
     }
-    return lhs;
-}
 
-Exprptr Parser::parse_additive() {
-    Span    span = now().span;
-    Exprptr lhs = parse_term();
-    while(match(TokenKind::ADD) || match(TokenKind::SUB)) {
-	auto op = (now().kind == TokenKind::ADD)? BinaryOp::Add : BinaryOp::Sub;
-	advance();
-	Exprptr rhs = parse_expr();
-	auto node = std::make_unique<NodeBin>(op, std::move(lhs), std::move(rhs), span);
-	lhs = std::move(node);
+    NodeBody* Parser::finish_body(size_t mark, Span span) {
+	NodeBody* b    = arena->make<NodeBody>();
+	b->span        = span;
+	b->stmts.items = arena->copy_array(stmt_scratch.data() + mark, stmt_scratch.size() - mark);
+	b->stmts.count = stmt_scratch.size() - mark;
+	stmt_scratch.resize(mark);
+	return b;
     }
-    return lhs;
+
+    NodeBody* Parser::parse_body() {
+	Span   span = now_span();
+	size_t mark = stmt_scratch.size();
+    // TODO:
+	while (!(now_kind() == TokenKind::KEYWORD && now_text() == "end" || now_text() == "else")) {
+	    if (now_kind() == TokenKind::TEOF) {
+		error_manager->report(Diagnostic(DiagnosticType::Error, span, "Missing 'end'", ""), true);
+	    }
+	    stmt_scratch.push_back(parse_stmt(false));
+	}
+    return finish_body(mark, span);
 }
 
-Exprptr Parser::parse_term() {
-    Span    span = now().span;
-    Exprptr lhs = parse_atom();
-    while(match(TokenKind::MUL) || match(TokenKind::DIV)) {
-	auto op = (now().kind == TokenKind::DIV)? BinaryOp::Div : BinaryOp::Mul;
+// Binding power of each binary operator token; 0 means "not a binary operator".
+// Every level is left-associative.
+struct BinaryInfo {
+    int      prec;
+    BinaryOp op;
+};
+static constexpr auto binary_ops = [] {
+    std::array<BinaryInfo, (size_t)TokenKind::TEOF + 1> t{};
+    t[(int)TokenKind::OR]   = {1, BinaryOp::Or};
+    t[(int)TokenKind::AND]  = {2, BinaryOp::And};
+    t[(int)TokenKind::BOR]  = {3, BinaryOp::Bor};
+    t[(int)TokenKind::BAND] = {4, BinaryOp::Band};
+    t[(int)TokenKind::EQEQ] = {5, BinaryOp::Eq};
+    t[(int)TokenKind::NE]   = {5, BinaryOp::Ne};
+    t[(int)TokenKind::LT]   = {6, BinaryOp::Lt};
+    t[(int)TokenKind::LE]   = {6, BinaryOp::Le};
+    t[(int)TokenKind::GT]   = {6, BinaryOp::Gt};
+    t[(int)TokenKind::GE]   = {6, BinaryOp::Ge};
+    t[(int)TokenKind::SHL]  = {7, BinaryOp::Shl};
+    t[(int)TokenKind::SHR]  = {7, BinaryOp::Shr};
+    t[(int)TokenKind::ADD]  = {8, BinaryOp::Add};
+    t[(int)TokenKind::SUB]  = {8, BinaryOp::Sub};
+    t[(int)TokenKind::MUL]  = {9, BinaryOp::Mul};
+    t[(int)TokenKind::DIV]  = {9, BinaryOp::Div};
+    t[(int)TokenKind::MOD]  = {9, BinaryOp::Mod};
+    return t;
+}();
+
+// Operator-precedence parse with explicit operand/operator stacks, so neither
+// long operator chains nor nested parentheses recurse on the native stack.
+Exprptr Parser::parse_expr() {
+    size_t op_mark  = op_scratch.size();
+    size_t val_mark = expr_scratch.size();
+    auto reduce = [&]() {
+	PendingOp op  = op_scratch.back();
+	op_scratch.pop_back();
+	Exprptr   rhs = expr_scratch.back();
+	expr_scratch.pop_back();
+	Exprptr   lhs = expr_scratch.back();
+	expr_scratch.back() = arena->make<NodeBin>(op.op, lhs, rhs, op.span);
+    };
+    int open = 0;
+    for (;;) {
+	// Operand position: open groups, then one atom.
+	while (match(TokenKind::OPEN_PAREN)) {
+	    op_scratch.push_back(PendingOp{0, BinaryOp::Add, now_span()});
+	    open++;
+	    advance();
+	}
+	expr_scratch.push_back(parse_atom());
+	// Operator position: close any groups opened by this expression.
+	while (open > 0 && match(TokenKind::CLOSE_PAREN)) {
+	    while (op_scratch.back().prec != 0) reduce();
+	    op_scratch.pop_back();
+	    open--;
+	    advance();
+	}
+	int prec = binary_ops[(int)now_kind()].prec;
+	if (prec == 0) break;
+	while (op_scratch.size() > op_mark && op_scratch.back().prec >= prec) reduce();
+	op_scratch.push_back(PendingOp{prec, binary_ops[(int)now_kind()].op, now_span()});
 	advance();
-	Exprptr rhs = parse_expr();
-	auto node = std::make_unique<NodeBin>(op, std::move(lhs), std::move(rhs), span);
-	lhs = std::move(node);
     }
-    return lhs;
+    while (op_scratch.size() > op_mark) {
+	if (op_scratch.back().prec == 0) {
+	    error_manager->report(Diagnostic(DiagnosticType::Error, op_scratch.back().span, "Unclosed '('", ""), true);
+	}
+	reduce();
+    }
+    Exprptr result = expr_scratch.back();
+    expr_scratch.resize(val_mark);
+    return result;
 }
 
-std::unique_ptr<NodeExpr> Parser::parse_atom() {
-    switch (now().kind) {
+Exprptr Parser::parse_atom() {
+    switch (now_kind()) {
     case TokenKind::KEYWORD: {
-	if (now().data == "if") {
-	    Span if_start    = now().span;
+	if (now_text() == "if") {
+	    Span if_start    = now_span();
 	    advance();
 	    Exprptr condition = parse_expr();
 	    expect(TokenKind::COLON);
-	    std::unique_ptr<NodeBody> then_body = parse_body();
-	    if (now().data == "end") {
+	    NodeBody* then_body = parse_body();
+	    if (now_text() == "end") {
 		expect_kw("end");
-		return std::make_unique<NodeIf>(std::move(condition), std::move(then_body), if_start);
-	    } else if (now().data == "else") {
+		return arena->make<NodeIf>(condition, then_body, if_start);
+	    } else if (now_text() == "else") {
 		expect_kw("else");
 		expect(TokenKind::COLON);
-		std::unique_ptr<NodeBody> else_body = parse_body();
+		NodeBody* else_body = parse_body();
 		expect_kw("end");
-		return std::make_unique<NodeIf>(std::move(condition), std::move(then_body), std::move(else_body), if_start);
+		return arena->make<NodeIf>(condition, then_body, else_body, if_start);
 	    }
-	} else if (now().data == "loop") {
-	    Span loop_start = now().span;
+	} else if (now_text() == "loop" || now_text() == "ploop") {
+	    Span        loop_start = now_span();
+	    bool        parallel   = now_text() == "ploop";
+	    const char* index      = nullptr;
 	    advance();
 	    Exprptr times   = parse_expr();
+	    if (parallel && now_kind() == TokenKind::KEYWORD && now_text() == "as") {
+		advance();
+		if (!match(TokenKind::NAME)) {
+		    error_manager->report(Diagnostic(DiagnosticType::Error, now_span(), "Expected an index name", ""), true);
+		}
+		index = arena->intern(now_text());
+		advance();
+	    }
 	    expect(TokenKind::COLON);
 	    auto    body    = parse_body();
 	    expect_kw("end");
-	    return std::make_unique<NodeLoop>(std::move(times), std::move(body), loop_start);
+	    auto    nloop   = arena->make<NodeLoop>(times, body, loop_start);
+	    nloop->parallel = parallel;
+	    nloop->index    = index;
+	    return nloop;
 	}
-	error_manager->add(Diagnostic(DiagnosticType::Error, now().span, "Invalid Expression", ""));
-	return std::make_unique<NodeNop>();
+	error_manager->add(Diagnostic(DiagnosticType::Error, now_span(), "Invalid Expression", ""));
+	return arena->make<NodeNop>();
     } break;
     case TokenKind::NAME: {
-	const char *name = strdup(now().data.c_str());
-	Span        span = now().span;
+	const char *name = arena->intern(now_text());
+	Span        span = now_span();
 	advance();
 	if (match(TokenKind::OPEN_PAREN)) {
 	    advance();
-	    std::unique_ptr<NodeExpr> callee =
-            std::make_unique<NodeIdent>(NodeIdent(name, span));
-	    std::vector<Exprptr> args;
+	    Exprptr callee = arena->make<NodeIdent>(name, span);
+	    size_t  mark   = expr_scratch.size();
 	    while (!match(TokenKind::CLOSE_PAREN)) {
-		args.push_back(parse_expr());
+		Exprptr arg = parse_expr();
+		expr_scratch.push_back(arg);
 		if (match(TokenKind::COMMA)) {
 		    advance();
 		    continue;
 		}
 	    }
 	    expect(TokenKind::CLOSE_PAREN);
-	    Exprptr call =
-            std::make_unique<NodeCall>(std::move(callee), std::move(args), span);
-	    return call;
+	    NodeList<Exprptr> args;
+	    args.items = arena->copy_array(expr_scratch.data() + mark, expr_scratch.size() - mark);
+	    args.count = expr_scratch.size() - mark;
+	    expr_scratch.resize(mark);
+	    return arena->make<NodeCall>(callee, args, span);
 	}
-	return std::make_unique<NodeIdent>(NodeIdent(name, span));
+	return arena->make<NodeIdent>(name, span);
     } break;
     case TokenKind::NUMBER: {
-	int64_t num  = std::stoi(now().data.c_str());
-	Span    span = now().span;
+	int64_t num  = 0;
+	Span    span = now_span();
+	auto    res  = std::from_chars(now_text().data(), now_text().data() + now_text().size(), num);
+	if (res.ec == std::errc::result_out_of_range) {
+	    error_manager->report(Diagnostic(DiagnosticType::Error, span, "Integer literal out of range", ""), true);
+	}
 	advance();
-	return std::make_unique<NodeInt>(num, span);
+	return arena->make<NodeInt>(num, span);
     } break;
     case TokenKind::STRING: {
-	const char *s    = strdup(now().data.c_str());
-	Span        span = now().span;
+	const char *s    = arena->intern(now_text());
+	Span        span = now_span();
 	advance();
-	return std::make_unique<NodeString>(s, span);
+	return arena->make<NodeString>(s, span);
     } break;
     default:
 	std::stringstream s;
 	s << "Invalid Expr\n";
-	error_manager->report(Diagnostic(DiagnosticType::Error, now().span, s.str(), ""), true);
+	error_manager->report(Diagnostic(DiagnosticType::Error, now_span(), s.str(), ""), true);
 	exit(1);
     }
 }
 void Parser::expect(TokenKind k) {
     if (!match(k)) {
 	std::stringstream s;
-	s << "Unexpected Token: '" << now().data << "'\n";
-	error_manager->report(Diagnostic(DiagnosticType::Error, now().span, s.str(), ""), true);
+	s << "Unexpected Token: '" << (now_kind() == TokenKind::TEOF ? "EOF" : now_text()) << "'\n";
+	error_manager->report(Diagnostic(DiagnosticType::Error, now_span(), s.str(), ""), true);
 	exit(1);
     }
     advance();
 }
-bool Parser::match(TokenKind k) { return (now().kind == k); }
 void Parser::expect_kw(const char *w) {
-    if (match(TokenKind::KEYWORD) && now().data == w) {
+    if (match(TokenKind::KEYWORD) && now_text() == w) {
 	advance();
 	return;
     }
     std::stringstream s;
     s << "Expected: '" << w << "'\n";
-    error_manager->report(Diagnostic(DiagnosticType::Error, now().span, s.str(), ""), true);
+    error_manager->report(Diagnostic(DiagnosticType::Error, now_span(), s.str(), ""), true);
     exit(1);
 }
 } // namespace Language
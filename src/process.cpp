@@ -0,0 +1,177 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <process.hpp>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace Tisp {
+    namespace Runtime {
+	ProcessTable::~ProcessTable() {
+	    for (size_t i = 0; i < procs.size(); i++) {
+		if (!procs[i].exited) {
+		    wait(i);
+		}
+	    }
+	}
+
+	int ProcessTable::spawn(const std::vector<std::string>& argv, bool capture) {
+	    Process proc;
+	    int     out_pipe[2] = {-1, -1};
+	    int     err_pipe[2] = {-1, -1};
+	    if (capture && (pipe2(out_pipe, O_CLOEXEC) < 0 || pipe2(err_pipe, O_CLOEXEC) < 0)) {
+		proc.exited = true;
+		proc.status = 127;
+		proc.err    = std::string("pipe: ") + strerror(errno) + "\n";
+		return add(std::move(proc));
+	    }
+
+	    posix_spawn_file_actions_t actions;
+	    posix_spawn_file_actions_init(&actions);
+	    if (capture) {
+		posix_spawn_file_actions_adddup2(&actions, out_pipe[1], 1);
+		posix_spawn_file_actions_adddup2(&actions, err_pipe[1], 2);
+	    }
+	    std::vector<char*> args;
+	    for (auto& arg : argv) {
+		args.push_back(const_cast<char*>(arg.c_str()));
+	    }
+	    args.push_back(nullptr);
+	    int error = argv.empty() ? ENOENT : posix_spawnp(&proc.pid, args[0], &actions, nullptr, args.data(), environ);
+	    posix_spawn_file_actions_destroy(&actions);
+
+	    if (capture) {
+		close(out_pipe[1]);
+		close(err_pipe[1]);
+		proc.out_fd = out_pipe[0];
+		proc.err_fd = err_pipe[0];
+	    }
+	    if (error != 0) {
+		if (capture) {
+		    close(proc.out_fd);
+		    close(proc.err_fd);
+		}
+		proc.out_fd = proc.err_fd = -1;
+		proc.exited = true;
+		proc.status = 127;
+		proc.err    = (argv.empty() ? std::string("spawn") : argv[0]) + ": " + strerror(error) + "\n";
+		if (!capture) {
+		    ::write(2, proc.err.data(), proc.err.size());
+		}
+	    } else {
+		running++;
+	    }
+	    return add(std::move(proc));
+	}
+
+	int ProcessTable::add(Process proc) {
+	    if (free.empty()) {
+		procs.push_back(std::move(proc));
+		return procs.size() - 1;
+	    }
+	    int handle = free.back();
+	    free.pop_back();
+	    procs[handle] = std::move(proc);
+	    return handle;
+	}
+
+	void ProcessTable::release(int handle) {
+	    procs[handle] = Process{};
+	    procs[handle].exited = true;
+	    free.push_back(handle);
+	}
+
+	// Appends one read of `fd` to `into`; closes it at EOF. The pipe is
+	// blocking, so only one read per poll() readiness: reading on until
+	// it is empty would block while the child waits on its other pipe.
+	static void drain(int& fd, std::string& into) {
+	    char    buffer[64 * 1024]; // a full pipe buffer
+	    ssize_t n;
+	    while ((n = read(fd, buffer, sizeof(buffer))) < 0 && errno == EINTR) {}
+	    if (n > 0) {
+		into.append(buffer, n);
+	    } else {
+		close(fd);
+		fd = -1;
+	    }
+	}
+
+	void ProcessTable::pump(int timeout_ms) {
+	    std::vector<pollfd>       fds;
+	    std::vector<std::string*> sinks;
+	    std::vector<int*>         owners;
+	    for (auto& proc : procs) {
+		if (proc.out_fd >= 0) {
+		    fds.push_back({proc.out_fd, POLLIN, 0});
+		    sinks.push_back(&proc.out);
+		    owners.push_back(&proc.out_fd);
+		}
+		if (proc.err_fd >= 0) {
+		    fds.push_back({proc.err_fd, POLLIN, 0});
+		    sinks.push_back(&proc.err);
+		    owners.push_back(&proc.err_fd);
+		}
+	    }
+	    if (!fds.empty()) {
+		int ready = poll(fds.data(), fds.size(), timeout_ms);
+		for (size_t i = 0; ready > 0 && i < fds.size(); i++) {
+		    if (fds[i].revents) {
+			drain(*owners[i], *sinks[i]);
+		    }
+		}
+	    }
+
+	    // A child is finished once its pipes are closed; children without
+	    // pipes are only ever reaped here or by wait().
+	    for (auto& proc : procs) {
+		if (proc.exited || proc.out_fd >= 0 || proc.err_fd >= 0) {
+		    continue;
+		}
+		int status;
+		// Block only when there is nothing else to wait on.
+		int flags = (fds.empty() && timeout_ms != 0) ? 0 : WNOHANG;
+		pid_t pid = waitpid(proc.pid, &status, flags);
+		if (pid == proc.pid) {
+		    proc.exited = true;
+		    proc.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+		    running--;
+		    if (flags == 0) return;
+		}
+	    }
+	}
+
+	int ProcessTable::wait(int handle) {
+	    Process& proc = procs[handle];
+	    while (!procs[handle].exited) {
+		if (proc.out_fd < 0 && proc.err_fd < 0) {
+		    int status;
+		    while (waitpid(proc.pid, &status, 0) < 0 && errno == EINTR) {}
+		    proc.exited = true;
+		    proc.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+		    running--;
+		    break;
+		}
+		pump(-1);
+	    }
+	    return procs[handle].status;
+	}
+
+	std::vector<std::string> split_command(std::string_view command) {
+	    std::vector<std::string> argv;
+	    size_t                   i = 0;
+	    while (i < command.size()) {
+		while (i < command.size() && isspace(command[i])) i++;
+		size_t start = i;
+		while (i < command.size() && !isspace(command[i])) i++;
+		if (i > start) {
+		    argv.emplace_back(command.substr(start, i - start));
+		}
+	    }
+	    return argv;
+	}
+    } // namespace Runtime
+} // namespace Tisp
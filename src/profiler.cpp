@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <iomanip>
+#include <profiler.hpp>
+#include <sys/time.h>
+#include <vm.hpp>
+
+namespace Tisp {
+    namespace Runtime {
+	// The started profiler, for the signal handler.
+	static std::atomic<Profiler*> active{nullptr};
+
+	static void on_sigprof(int) {
+	    if (Profiler* profiler = active.load(std::memory_order_relaxed)) {
+		profiler->pending.fetch_add(1, std::memory_order_relaxed);
+	    }
+	}
+
+	Profiler::~Profiler() {
+	    stop();
+	}
+
+	void Profiler::start() {
+	    struct sigaction action;
+	    memset(&action, 0, sizeof(action));
+	    action.sa_handler = on_sigprof;
+	    // Restart interrupted reads and writes; poll() and waitpid() callers
+	    // already retry on EINTR.
+	    action.sa_flags = SA_RESTART;
+	    sigemptyset(&action.sa_mask);
+	    active = this;
+	    sigaction(SIGPROF, &action, nullptr);
+	    itimerval timer;
+	    timer.it_interval.tv_sec  = 0;
+	    timer.it_interval.tv_usec = interval_us;
+	    timer.it_value            = timer.it_interval;
+	    setitimer(ITIMER_PROF, &timer, nullptr);
+	    running = true;
+	}
+
+	void Profiler::stop() {
+	    if (!running) {
+		return;
+	    }
+	    itimerval timer;
+	    memset(&timer, 0, sizeof(timer));
+	    setitimer(ITIMER_PROF, &timer, nullptr);
+	    signal(SIGPROF, SIG_IGN);
+	    active  = nullptr;
+	    pending = 0;
+	    running = false;
+	}
+
+	void Profiler::record(const std::vector<ProfileSite>& stack, uint32_t ticks) {
+	    std::lock_guard<std::mutex> guard(lock);
+	    stacks[stack] += ticks;
+	    samples += ticks;
+	}
+
+	void Profiler::write_lines(SourceManager& sources, std::ostream& out, size_t limit) {
+	    struct Line {
+		uint64_t self   = 0;
+		uint64_t total  = 0;
+		uint32_t offset = 0;
+	    };
+	    // Keyed by (file, line). A line counts once per sample however many
+	    // frames of the stack are on it, as in recursion.
+	    std::map<std::pair<uint16_t, int>, Line> lines;
+	    std::vector<Line*>                       seen;
+	    for (auto& [stack, count] : stacks) {
+		seen.clear();
+		Line* line = nullptr;
+		for (auto& site : stack) {
+		    line         = &lines[{site.span.file, sources.locate(site.span.file, site.span.offset).line}];
+		    line->offset = site.span.offset;
+		    if (std::find(seen.begin(), seen.end(), line) == seen.end()) {
+			seen.push_back(line);
+			line->total += count;
+		    }
+		}
+		line->self += count;
+	    }
+	    std::vector<std::pair<std::pair<uint16_t, int>, Line>> rows(lines.begin(), lines.end());
+	    std::stable_sort(rows.begin(), rows.end(), [](auto& a, auto& b) {
+		return a.second.self != b.second.self ? a.second.self > b.second.self : a.second.total > b.second.total;
+	    });
+	    if (rows.size() > limit) {
+		rows.resize(limit);
+	    }
+
+	    auto percent = [&](uint64_t n) {
+		return samples ? 100.0 * n / samples : 0.0;
+	    };
+	    out << "profile: " << samples << " samples, " << std::fixed << std::setprecision(3)
+		<< samples * interval_us / 1e6 << " s CPU\n";
+	    out << "  self%  total%  location\n";
+	    for (auto& [key, line] : rows) {
+		auto             loc  = sources.locate(key.first, line.offset);
+		std::string_view text = loc.text;
+		text.remove_prefix(std::min(text.find_first_not_of(" \t"), text.size()));
+		out << std::setprecision(1) << std::setw(6) << percent(line.self) << "%" << std::setw(7)
+		    << percent(line.total) << "%  " << loc.file << ":" << loc.line << "  " << text << "\n";
+	    }
+	}
+
+	void Profiler::write_folded(SourceManager& sources, std::ostream& out) {
+	    // Sites on the same line print the same, so merge after formatting.
+	    std::map<std::string, uint64_t> folded;
+	    std::string                     line;
+	    for (auto& [stack, count] : stacks) {
+		line.clear();
+		for (auto& site : stack) {
+		    auto loc = sources.locate(site.span.file, site.span.offset);
+		    if (!line.empty()) line += ';';
+		    line += site.function;
+		    line += " (";
+		    line += loc.file;
+		    line += ':';
+		    line += std::to_string(loc.line);
+		    line += ')';
+		}
+		folded[line] += count;
+	    }
+	    for (auto& [stack, count] : folded) {
+		out << stack << " " << count << "\n";
+	    }
+	}
+
+	// The function whose code holds `ip`: the one with the closest entry
+	// at or before it. Top-level code comes before every function.
+	static const char* function_at(const Chunk& chunk, size_t ip) {
+	    const FunctionInfo* best = nullptr;
+	    for (auto& fn : chunk.functions) {
+		if (fn.entry <= ip && (!best || fn.entry > best->entry)) {
+		    best = &fn;
+		}
+	    }
+	    return best ? best->name : "<script>";
+	}
+
+	void Vm::sample(const Chunk& chunk, size_t ip) {
+	    uint32_t ticks = profiler ? profiler->pending.exchange(0, std::memory_order_relaxed) : 0;
+	    if (!ticks) {
+		return;
+	    }
+	    std::vector<ProfileSite> stack;
+	    for (auto& frame : frames) {
+		// A `ploop` body's frame returns to a Halt and has no caller
+		// in this run.
+		if (chunk.code[frame.return_ip] == uint8_t(OpCode::Halt)) {
+		    continue;
+		}
+		// The last operand byte of the Call shares its span.
+		size_t call = frame.return_ip - 1;
+		stack.push_back(ProfileSite{function_at(chunk, call), chunk.spans[call]});
+	    }
+	    stack.push_back(ProfileSite{function_at(chunk, ip), chunk.spans[ip]});
+	    profiler->record(stack, ticks);
+	}
+
+	void Vm::sample(Span span) {
+	    uint32_t ticks = profiler ? profiler->pending.exchange(0, std::memory_order_relaxed) : 0;
+	    if (!ticks) {
+		return;
+	    }
+	    std::vector<ProfileSite> stack;
+	    const char*              function = worker ? "<ploop>" : "<script>";
+	    for (auto& frame : frames) {
+		stack.push_back(ProfileSite{function, frame.site});
+		function = program.functions[frame.return_ip]->name;
+	    }
+	    stack.push_back(ProfileSite{function, span});
+	    profiler->record(stack, ticks);
+	}
+    } // namespace Runtime
+} // namespace Tisp
@@ -0,0 +1,207 @@
+#include <builtins.hpp>
+#include <cstring>
+#include <resolver.hpp>
+
+namespace Tisp {
+    namespace Language {
+	void Resolver::resolve(Node& program) {
+	    this->program = &program;
+	    auto body     = std::get<NodeBody*>(program.stmt->stmt);
+	    // Functions are visible everywhere, including before their definition.
+	    for (auto stmt : body->stmts) {
+		if (stmt->kind != StmtKind::Function) continue;
+		auto fn = std::get<NodeFunction*>(stmt->stmt);
+		if (!functions.emplace(fn->name, program.functions.size()).second) {
+		    std::stringstream s;
+		    s << "Function Already Defined: '" << fn->name << "'";
+		    error_manager->report(Diagnostic(DiagnosticType::Error, fn->span, s.str(), ""), true);
+		}
+		fn->index = program.functions.size();
+		program.functions.push_back(fn);
+		if (strcmp(fn->name, "main") == 0) {
+		    if (fn->params.size() != 0) {
+			error_manager->report(Diagnostic(DiagnosticType::Error, fn->span, "'main' takes no parameters", ""), true);
+		    }
+		    program.main = fn->index;
+		}
+	    }
+	    resolve_body(body);
+	    program.frame_size = globals.size();
+	    // Bodies last, so they also see globals bound after the definition.
+	    for (auto fn : program.functions) {
+		resolve_function(fn);
+	    }
+	}
+
+	void Resolver::resolve_function(NodeFunction* fn) {
+	    current = fn;
+	    scopes.emplace_back();
+	    auto& locals = scopes.back().locals;
+	    for (auto param : fn->params) {
+		if (!locals.emplace(param, locals.size()).second) {
+		    std::stringstream s;
+		    s << "Duplicate Parameter: '" << param << "'";
+		    error_manager->report(Diagnostic(DiagnosticType::Error, fn->span, s.str(), ""), true);
+		}
+	    }
+	    resolve_body(fn->body);
+	    fn->frame_size = scopes.back().locals.size();
+	    current        = nullptr;
+	    scopes.pop_back();
+	}
+
+	void Resolver::resolve_parallel(NodeLoop* loop) {
+	    scopes.emplace_back();
+	    scopes.back().loop = loop;
+	    // Slot 0 holds the index, named or not ("" is never an identifier).
+	    scopes.back().locals.emplace(loop->index ? loop->index : "", 0);
+	    resolve_body(loop->body);
+	    Scope& scope        = scopes.back();
+	    loop->frame_size    = scope.locals.size();
+	    loop->captures.items = program->arena->copy_array(scope.captures.data(), scope.captures.size());
+	    loop->captures.count = scope.captures.size();
+	    scopes.pop_back();
+	}
+
+	// Slot of `name` in scopes[scope], or -1 if no local scope binds it.
+	// A name bound outside a `ploop` is captured into the loop's frame,
+	// and into every `ploop` frame in between.
+	int32_t Resolver::lookup_local(size_t scope, const std::string& name) {
+	    auto& locals = scopes[scope].locals;
+	    auto  it     = locals.find(name);
+	    if (it != locals.end()) {
+		return it->second;
+	    }
+	    if (!scopes[scope].loop || scope == 0) {
+		return -1;
+	    }
+	    int32_t outer = lookup_local(scope - 1, name);
+	    if (outer < 0) {
+		return -1;
+	    }
+	    int32_t inner = locals.size();
+	    locals.emplace(name, inner);
+	    scopes[scope].captures.push_back(Capture{outer, inner});
+	    return inner;
+	}
+
+	void Resolver::resolve_body(NodeBody* body) {
+	    for (auto stmt : body->stmts) {
+		resolve_stmt(stmt);
+	    }
+	}
+
+	void Resolver::resolve_stmt(NodeStmt* n) {
+	    switch (n->kind) {
+	    case StmtKind::Assignment: {
+		NodeAssignment* node = std::get<NodeAssignment*>(n->stmt);
+		// The initializer sees the previous binding, so `let x = x + 1;` works.
+		resolve_expr(node->expr);
+		auto& scope = scopes.empty() ? globals : scopes.back().locals;
+		auto  it    = scope.find(node->name);
+		if (it == scope.end()) {
+		    it = scope.emplace(node->name, scope.size()).first;
+		}
+		node->slot   = it->second;
+		node->global = scopes.empty();
+	    } break;
+	    case StmtKind::Expr:
+		resolve_expr(std::get<NodeExprStmt*>(n->stmt)->expr);
+		break;
+	    case StmtKind::Return: {
+		auto node = std::get<NodeReturn*>(n->stmt);
+		if (!current) {
+		    error_manager->report(Diagnostic(DiagnosticType::Error, node->span, "'return' outside of a function", ""), true);
+		}
+		if (scopes.back().loop) {
+		    error_manager->report(Diagnostic(DiagnosticType::Error, node->span, "'return' inside 'ploop'", ""), true);
+		}
+		if (node->value) {
+		    resolve_expr(node->value);
+		}
+	    } break;
+	    default:
+		break;
+	    }
+	}
+
+	void Resolver::resolve_expr(NodeExpr* expr) {
+	    switch (expr->kind) {
+	    case ExprKind::Ident: {
+		auto nid = static_cast<NodeIdent*>(expr);
+		if (!scopes.empty()) {
+		    int32_t slot = lookup_local(scopes.size() - 1, nid->identifier);
+		    if (slot >= 0) {
+			nid->slot = slot;
+			break;
+		    }
+		}
+		auto it = globals.find(nid->identifier);
+		if (it == globals.end()) {
+		    std::stringstream s;
+		    s << "Variable Not Declared: '" << nid->identifier << "'";
+		    error_manager->report(Diagnostic(DiagnosticType::Error, expr->span, s.str(), ""), true);
+		}
+		nid->slot   = it->second;
+		nid->global = true;
+	    } break;
+	    case ExprKind::Bin: {
+		// Operator chains are left-deep; walk the left spine instead of recursing.
+		size_t    mark = spine.size();
+		NodeExpr* left = expr;
+		while (left->kind == ExprKind::Bin) {
+		    spine.push_back(static_cast<NodeBin*>(left));
+		    left = static_cast<NodeBin*>(left)->lhs;
+		}
+		resolve_expr(left);
+		while (spine.size() > mark) {
+		    NodeBin* nbin = spine.back();
+		    spine.pop_back();
+		    resolve_expr(nbin->rhs);
+		}
+	    } break;
+	    case ExprKind::Call: {
+		// The callee names a function, not a variable. User functions take
+		// precedence over natives; anything else is left to the runtime.
+		auto ncall = static_cast<NodeCall*>(expr);
+		if (ncall->callee->kind == ExprKind::Ident) {
+		    auto it = functions.find(static_cast<NodeIdent*>(ncall->callee)->identifier);
+		    if (it != functions.end()) {
+			ncall->function = it->second;
+			auto fn         = program->functions[it->second];
+			if (fn->params.size() != ncall->args.size()) {
+			    std::stringstream s;
+			    s << "'" << fn->name << "' expects " << fn->params.size() << " argument(s), got " << ncall->args.size();
+			    error_manager->report(Diagnostic(DiagnosticType::Error, expr->span, s.str(), ""), true);
+			}
+		    } else {
+			ncall->native = Runtime::Builtin::find_native(static_cast<NodeIdent*>(ncall->callee)->identifier);
+		    }
+		}
+		for (auto arg : ncall->args) {
+		    resolve_expr(arg);
+		}
+	    } break;
+	    case ExprKind::If: {
+		auto nif = static_cast<NodeIf*>(expr);
+		resolve_expr(nif->condition);
+		resolve_body(nif->then_body);
+		if (nif->else_body) {
+		    resolve_body(nif->else_body);
+		}
+	    } break;
+	    case ExprKind::Loop: {
+		auto nloop = static_cast<NodeLoop*>(expr);
+		resolve_expr(nloop->times);
+		if (nloop->parallel) {
+		    resolve_parallel(nloop);
+		} else {
+		    resolve_body(nloop->body);
+		}
+	    } break;
+	    default:
+		break;
+	    }
+	}
+    } // namespace Language
+} // namespace Tisp
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <cstdlib>
+#include <scheduler.hpp>
+
+namespace Tisp {
+    namespace Runtime {
+	Scheduler::Scheduler(size_t workers) : workers(workers), ranges(new Range[workers]) {
+	    for (size_t w = 1; w < workers; w++) {
+		threads.emplace_back(&Scheduler::helper, this, w);
+	    }
+	}
+
+	Scheduler::~Scheduler() {
+	    {
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	    }
+	    wake.notify_all();
+	    for (auto& thread : threads) {
+		thread.join();
+	    }
+	}
+
+	size_t Scheduler::default_workers() {
+	    if (const char* env = getenv("TISP_THREADS")) {
+		long n = atol(env);
+		if (n > 0) return n;
+	    }
+	    return std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	void Scheduler::run(size_t count, const Task& fn) {
+	    for (size_t w = 0; w < workers; w++) {
+		std::lock_guard<std::mutex> guard(ranges[w].lock);
+		ranges[w].begin = count * w / workers;
+		ranges[w].end   = count * (w + 1) / workers;
+	    }
+	    {
+		std::lock_guard<std::mutex> guard(lock);
+		task = &fn;
+		busy = threads.size();
+		generation++;
+	    }
+	    wake.notify_all();
+	    work(0);
+	    std::unique_lock<std::mutex> guard(lock);
+	    done.wait(guard, [&]() { return busy == 0; });
+	    task = nullptr;
+	}
+
+	void Scheduler::work(size_t worker) {
+	    Range& own = ranges[worker];
+	    for (;;) {
+		size_t next;
+		{
+		    std::lock_guard<std::mutex> guard(own.lock);
+		    next = own.begin < own.end ? own.begin++ : SIZE_MAX;
+		}
+		if (next != SIZE_MAX) {
+		    (*task)(next, worker);
+		} else if (!steal(worker)) {
+		    return;
+		}
+	    }
+	}
+
+	// Moves the back half of the first non-empty range found into
+	// `worker`'s own (empty) range.
+	bool Scheduler::steal(size_t worker) {
+	    for (size_t i = 1; i < workers; i++) {
+		Range& victim = ranges[(worker + i) % workers];
+		size_t begin, end;
+		{
+		    std::lock_guard<std::mutex> guard(victim.lock);
+		    if (victim.begin >= victim.end) continue;
+		    begin      = victim.begin + (victim.end - victim.begin) / 2;
+		    end        = victim.end;
+		    victim.end = begin;
+		}
+		std::lock_guard<std::mutex> guard(ranges[worker].lock);
+		ranges[worker].begin = begin;
+		ranges[worker].end   = end;
+		return true;
+	    }
+	    return false;
+	}
+
+	void Scheduler::helper(size_t worker) {
+	    uint64_t seen = 0;
+	    for (;;) {
+		{
+		    std::unique_lock<std::mutex> guard(lock);
+		    wake.wait(guard, [&]() { return stopping || generation != seen; });
+		    if (stopping) return;
+		    seen = generation;
+		}
+		work(worker);
+		std::lock_guard<std::mutex> guard(lock);
+		if (--busy == 0) done.notify_one();
+	    }
+	}
+    } // namespace Runtime
+} // namespace Tisp
@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <source.hpp>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Tisp {
+    SourceBuffer& SourceBuffer::operator=(SourceBuffer&& o) {
+	if (this != &o) {
+	    release();
+	    data     = o.data;
+	    size     = o.size;
+	    mapped   = o.mapped;
+	    o.data   = nullptr;
+	    o.size   = 0;
+	    o.mapped = false;
+	}
+	return *this;
+    }
+
+    bool SourceBuffer::open(const std::string& path) {
+	release();
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return false;
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+	    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	    if (p != MAP_FAILED) {
+		madvise(p, st.st_size, MADV_SEQUENTIAL);
+		data   = static_cast<const char*>(p);
+		size   = st.st_size;
+		mapped = true;
+		close(fd);
+		return true;
+	    }
+	}
+	size_t cap = 4096;
+	char*  buf = static_cast<char*>(malloc(cap));
+	size_t len = 0;
+	ssize_t n;
+	while ((n = read(fd, buf + len, cap - len)) > 0) {
+	    len += n;
+	    if (len == cap) {
+		cap *= 2;
+		buf = static_cast<char*>(realloc(buf, cap));
+	    }
+	}
+	close(fd);
+	if (n < 0) {
+	    free(buf);
+	    return false;
+	}
+	data = buf;
+	size = len;
+	return true;
+    }
+
+    int SourceManager::load(const std::string& path) {
+	auto file  = std::make_unique<SourceFile>();
+	file->name = path;
+	if (!file->buffer.open(path)) return -1;
+	files.push_back(std::move(file));
+	return files.size() - 1;
+    }
+
+    int SourceManager::add(const std::string& name, std::string_view text) {
+	auto file  = std::make_unique<SourceFile>();
+	file->name = name;
+	file->buffer.copy_from(text);
+	files.push_back(std::move(file));
+	return files.size() - 1;
+    }
+
+    SourceLocation SourceManager::locate(uint16_t id, uint32_t offset) {
+	SourceFile&      file = *files.at(id);
+	std::string_view src  = file.buffer.view();
+	if (file.line_starts.empty()) {
+	    file.line_starts.push_back(0);
+	    for (size_t i = 0; i < src.size(); i++) {
+		if (src[i] == '\n') file.line_starts.push_back(i + 1);
+	    }
+	}
+	if (offset > src.size()) offset = src.size();
+	auto   it    = std::upper_bound(file.line_starts.begin(), file.line_starts.end(), offset);
+	size_t line  = (it - file.line_starts.begin()) - 1;
+	size_t start = file.line_starts[line];
+	size_t end   = src.find('\n', start);
+	if (end == std::string_view::npos) end = src.size();
+	return SourceLocation{file.name, src.substr(start, end - start), int(line + 1), int(offset - start + 1)};
+    }
+
+    void SourceBuffer::copy_from(std::string_view text) {
+	release();
+	char* buf = static_cast<char*>(malloc(text.size() + 1));
+	memcpy(buf, text.data(), text.size());
+	buf[text.size()] = '\0';
+	data = buf;
+	size = text.size();
+    }
+
+    void SourceBuffer::release() {
+	if (!data) return;
+	if (mapped) {
+	    munmap(const_cast<char*>(data), size);
+	} else {
+	    free(const_cast<char*>(data));
+	}
+	data   = nullptr;
+	size   = 0;
+	mapped = false;
+    }
+} // namespace Tisp
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <builtins.hpp>
+#include <iomanip>
+#include <ostream>
+#include <sys/resource.h>
+#include <vm.hpp>
+
+namespace Tisp {
+    namespace Runtime {
+	// In ExprKind and OpCode declaration order.
+	static const char* const expr_names[] = {"int", "string", "call", "ident", "bin", "if", "loop", "block", "nop"};
+	static_assert(std::size(expr_names) == std::size(Stats{}.exprs));
+	static const char* const op_names[] = {
+	    "Const", "Nil", "Pop", "GetLocal", "SetLocal", "GetGlobal", "SetGlobal", "Add", "Sub", "Mul", "Div",
+	    "Mod", "Shl", "Shr", "Band", "Bor", "Lt", "Le", "Gt", "Ge", "Eq", "Ne", "AddInt", "SubInt", "MulInt",
+	    "DivInt", "ModInt", "ShlInt", "ShrInt", "BandInt", "BorInt", "LtInt", "LeInt", "GtInt", "GeInt",
+	    "EqInt", "NeInt", "Jump", "JumpIfFalse", "AndJump", "OrJump", "ToBool", "LoopEnter", "LoopTest",
+	    "LoopStep", "LoopTestJit", "ParallelLoop", "CallNative", "Call", "TailCall", "Return", "Halt",
+	};
+	static_assert(std::size(op_names) == std::size(Stats{}.ops));
+	static const char* const obj_names[] = {"int", "string", "error"};
+#if TISP_STATS
+	static constexpr bool counters = true;
+#else
+	static constexpr bool counters = false;
+#endif
+
+	void Stats::merge(const Stats& o) {
+	    for (size_t i = 0; i < std::size(exprs); i++) exprs[i] += o.exprs[i];
+	    for (size_t i = 0; i < std::size(ops); i++) ops[i] += o.ops[i];
+	    for (size_t i = 0; i < max_natives; i++) {
+		natives[i].calls += o.natives[i].calls;
+		natives[i].ns += o.natives[i].ns;
+	    }
+	    lookups += o.lookups;
+	    misses += o.misses;
+	}
+
+	// "name": value pairs (or "name value" columns) for the non-zero
+	// entries of `counts`, largest first.
+	template <typename Names>
+	static void write_counts(std::ostream& out, bool json, const Names& names, const uint64_t* counts, size_t n) {
+	    std::vector<size_t> order;
+	    for (size_t i = 0; i < n; i++) {
+		if (counts[i]) order.push_back(i);
+	    }
+	    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return counts[a] > counts[b]; });
+	    for (size_t k = 0; k < order.size(); k++) {
+		if (json) {
+		    out << (k ? ", " : "") << "\"" << names[order[k]] << "\": " << counts[order[k]];
+		} else {
+		    out << "  " << names[order[k]] << " " << counts[order[k]];
+		}
+	    }
+	}
+
+	void Vm::write_stats(std::ostream& out, bool json) {
+	    Stats                  total = stats;
+	    Value::GcStats         gc    = heap.stats;
+	    uint64_t               allocations[std::size(obj_names)];
+	    for (size_t i = 0; i < std::size(obj_names); i++) {
+		allocations[i] = gc.allocations[i];
+	    }
+	    for (auto& pw : workers) {
+		if (!pw->vm) continue;
+		total.merge(pw->vm->stats);
+		for (size_t i = 0; i < std::size(obj_names); i++) {
+		    allocations[i] += pw->vm->heap.stats.allocations[i];
+		}
+	    }
+	    uint64_t instructions = 0;
+	    for (auto n : total.ops) instructions += n;
+	    uint64_t evaluations = 0;
+	    for (auto n : total.exprs) evaluations += n;
+	    rusage usage;
+	    getrusage(RUSAGE_SELF, &usage);
+	    long peak_rss_kib = usage.ru_maxrss;
+
+	    if (json) {
+		out << "{\"counters\": " << (counters ? "true" : "false");
+		out << ", \"allocations\": {";
+		write_counts(out, true, obj_names, allocations, std::size(obj_names));
+		out << "}, \"evaluations\": {";
+		write_counts(out, true, expr_names, total.exprs, std::size(total.exprs));
+		out << "}, \"instructions\": {";
+		write_counts(out, true, op_names, total.ops, std::size(total.ops));
+		out << "}, \"lookups\": " << total.lookups << ", \"misses\": " << total.misses;
+		out << ", \"natives\": {";
+		bool first = true;
+		for (size_t i = 0; i < std::size(Builtin::natives); i++) {
+		    if (!total.natives[i].calls) continue;
+		    out << (first ? "" : ", ") << "\"" << Builtin::natives[i].name << "\": {\"calls\": "
+			<< total.natives[i].calls << ", \"ns\": " << total.natives[i].ns << "}";
+		    first = false;
+		}
+		out << "}, \"gc\": {\"collections\": " << gc.collections << ", \"freed_objects\": " << gc.freed_objects
+		    << ", \"peak_bytes\": " << gc.peak_bytes << ", \"pause_ms\": " << gc.pause_ms << "}";
+		out << ", \"peak_rss_kib\": " << peak_rss_kib << "}\n";
+		return;
+	    }
+
+	    out << "stats:\n";
+	    if (!counters) {
+		out << "  (counters not built in; rebuild with STATS=1)\n";
+	    }
+	    uint64_t allocated = 0;
+	    for (auto n : allocations) allocated += n;
+	    out << "  allocations " << allocated;
+	    write_counts(out, false, obj_names, allocations, std::size(obj_names));
+	    out << "\n  evaluations " << evaluations;
+	    write_counts(out, false, expr_names, total.exprs, std::size(total.exprs));
+	    out << "\n  instructions " << instructions;
+	    write_counts(out, false, op_names, total.ops, std::size(total.ops));
+	    out << "\n  lookups " << total.lookups << " (" << total.misses << " nil)\n";
+	    out << "  natives\n";
+	    for (size_t i = 0; i < std::size(Builtin::natives); i++) {
+		if (!total.natives[i].calls) continue;
+		out << "    " << std::left << std::setw(9) << Builtin::natives[i].name << std::right << std::setw(10)
+		    << total.natives[i].calls << " calls " << std::fixed << std::setprecision(3) << std::setw(10)
+		    << total.natives[i].ns / 1e6 << " ms\n";
+	    }
+	    out << "  peak rss " << peak_rss_kib << " KiB\n";
+	}
+    } // namespace Runtime
+} // namespace Tisp
@@ -1,7 +1,129 @@
+#include <algorithm>
 #include <value.hpp>
 
 namespace Tisp {
     namespace Value {
-	
+	Heap::~Heap() {
+	    Obj* o = objects;
+	    while (o) {
+		Obj* next = o->next;
+		switch (o->kind) {
+		case ObjKind::Int:     delete static_cast<ObjInt*>(o);     break;
+		case ObjKind::String:
+		case ObjKind::Error:   delete static_cast<ObjString*>(o);  break;
+		}
+		o = next;
+	    }
+	}
+
+	size_t Heap::object_size(const Obj* o) {
+	    switch (o->kind) {
+	    case ObjKind::Int:
+		return sizeof(ObjInt);
+	    case ObjKind::String:
+	    case ObjKind::Error:
+		return sizeof(ObjString) + static_cast<const ObjString*>(o)->value.capacity();
+	    }
+	    return sizeof(Obj);
+	}
+
+	void Heap::sweep() {
+	    Obj** link = &objects;
+	    while (Obj* o = *link) {
+		if (o->marked) {
+		    o->marked = false;
+		    link = &o->next;
+		    continue;
+		}
+		*link = o->next;
+		if (o->kind == ObjKind::String && static_cast<ObjString*>(o)->interned) {
+		    strings.erase(static_cast<ObjString*>(o)->value);
+		}
+		size_t size = object_size(o);
+		bytes_allocated -= size;
+		stats.freed_bytes += size;
+		stats.freed_objects++;
+		switch (o->kind) {
+		case ObjKind::Int:     delete static_cast<ObjInt*>(o);     break;
+		case ObjKind::String:
+		case ObjKind::Error:   delete static_cast<ObjString*>(o);  break;
+		}
+	    }
+	    stats.collections++;
+	    next_gc = std::max(min_threshold, bytes_allocated * 2);
+	}
+
+	Value Heap::intern(std::string_view value) {
+	    if (Value::fits_small_str(value)) {
+		return Value::small_str(value);
+	    }
+	    auto it = strings.find(value);
+	    if (it != strings.end()) {
+		return Value::from_obj(it->second);
+	    }
+	    ObjString* str = allocate<ObjString>(ObjKind::String, std::string(value));
+	    str->interned  = id;
+	    strings.emplace(str->value, str);
+	    return Value::from_obj(str);
+	}
+
+	bool Value::equals(Value other) const {
+	    if (bits == other.bits) {
+		return true;
+	    }
+	    if (is_int() && other.is_int()) {
+		return as_int() == other.as_int();
+	    }
+	    // Inline strings are canonical, so they only ever equal themselves.
+	    if (!is_obj() || !other.is_obj() || as_obj()->kind != ObjKind::String ||
+		other.as_obj()->kind != ObjKind::String) {
+		return false;
+	    }
+	    auto a = static_cast<ObjString*>(as_obj());
+	    auto b = static_cast<ObjString*>(other.as_obj());
+	    if (a->interned && a->interned == b->interned) {
+		return false;
+	    }
+	    return a->hash == b->hash && a->value == b->value;
+	}
+
+	uint64_t Value::hash() const {
+	    if (is_int()) {
+		return std::hash<int64_t>()(as_int());
+	    }
+	    if (is_obj() && as_obj()->kind == ObjKind::String) {
+		return static_cast<ObjString*>(as_obj())->hash;
+	    }
+	    return std::hash<uint64_t>()(bits);
+	}
+
+	bool Value::is_truthy() const {
+	    if (is_int()) {
+		return as_int() > 0;
+	    }
+	    return false;
+	}
+
+	bool Value::is_falsy() const {
+	    if (is_int()) {
+		return as_int() < 0;
+	    }
+	    return false;
+	}
+
+	std::string Value::to_string() const {
+	    std::string repr;
+	    switch (kind()) {
+	    case ValueKind::String:
+		repr = std::string(as_string());
+		break;
+	    case ValueKind::Number:
+		repr = std::to_string(as_int());
+		break;
+	    default:
+		break;
+	    }
+	    return repr;
+	}
     }
 }
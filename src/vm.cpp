@@ -1,7 +1,7 @@
 #include "parser.hpp"
 #include "value.hpp"
 #include <builtins.hpp>
-#include <cassert>
+#include <chrono>
 #include <cstdio>
 #include <memory>
 #include <string.h>
@@ -9,132 +9,315 @@
 using namespace Tisp::Language;
 using namespace Tisp::Runtime;
 using namespace Tisp::Value;
-using Tisp::Value::Value;
 
 Vm::Vm(Language::Node program, ErrorManager* em): error_manager(em) {
     this->program = std::move(program);
-    this->builtins["println"] = Runtime::Builtin::println;
-    this->builtins["print"]   = Runtime::Builtin::print;
-    this->builtins["exec"]    = Runtime::Builtin::exec;
+    this->env.slots.resize(this->program.frame_size);
 }
 
 void Vm::execute() {
-    auto stmt = std::get<NodeBody*>(program.stmt->stmt);
-    for (auto &node : stmt->stmts) {
-	execute_node(node.get());
+    execute_body(std::get<NodeBody*>(program.stmt->stmt));
+    if (program.main >= 0) {
+	NodeFunction* fn = program.functions[program.main];
+	call_function(fn, stack.size(), fn->span);
     }
 }
 
+// Runs statements until the body ends or a `return` unwinds through it.
+void Vm::execute_body(NodeBody* body) {
+    for (auto node : body->stmts) {
+	execute_node(node);
+	if (returning) {
+	    return;
+	}
+    }
+}
+
+// Runs `fn` with its arguments already at stack[base..]. A `return g(...)`
+// leaves its arguments in tail_args and is restarted here in the same frame,
+// so tail recursion needs neither native stack nor frames.
+Tisp::Value::Value Vm::call_function(NodeFunction* fn, size_t base, Span span) {
+    if (frames.size() >= max_tree_frames) {
+	out.flush();
+	error_manager->report(Diagnostic(DiagnosticType::Error, span, "Stack overflow", ""), true);
+    }
+    frames.push_back(Frame{size_t(fn->index), bp, span});
+    bp = base;
+    for (;;) {
+	stack.resize(base + fn->frame_size);
+	execute_body(fn->body);
+	if (!tail_call) {
+	    break;
+	}
+	fn        = tail_call;
+	tail_call = nullptr;
+	frames.back().return_ip = fn->index;
+	returning = false;
+	std::copy(tail_args.begin(), tail_args.end(), stack.begin() + base);
+	stack.resize(base + tail_args.size());
+	tail_args.clear();
+    }
+    Value::Value result = returning ? return_value : Value::Value::nil();
+    returning    = false;
+    return_value = Value::Value::nil();
+    stack.resize(base);
+    bp = frames.back().bp;
+    frames.pop_back();
+    return result;
+}
+
+void Vm::collect_garbage() {
+    auto start = std::chrono::steady_clock::now();
+    for (auto value : env.slots) {
+	Heap::mark(value);
+    }
+    for (auto value : stack) {
+	Heap::mark(value);
+    }
+    Heap::mark(return_value);
+    for (auto value : tail_args) {
+	Heap::mark(value);
+    }
+    for (auto value : pinned) {
+	Heap::mark(value);
+    }
+    for (auto& proc : processes.procs) {
+	Heap::mark(proc.out_value);
+	Heap::mark(proc.err_value);
+    }
+    heap.sweep();
+    std::chrono::duration<double, std::milli> pause = std::chrono::steady_clock::now() - start;
+    heap.stats.pause_ms += pause.count();
+}
+
 void Vm::execute_node(NodeStmt* n) {
+    // Statement boundaries are the tree-walker's safe points; temporaries
+    // still needed by an enclosing expression are kept on `stack`.
+    if (heap.should_collect()) {
+	collect_garbage();
+    }
+    if (profiler && profiler->pending.load(std::memory_order_relaxed)) {
+	sample(n->span);
+    }
     switch (n->kind) {
     case StmtKind::Assignment: {
 	NodeAssignment* node  = std::get<NodeAssignment*>(n->stmt);
-	Value::ValuePtr value = generate_value(node->expr.get());
-	
-	if (value->kind != ValueKind::Object) {
-	    env.variables[node->name] = Value::Value::obj_from_Value(node->name, value);
+	Value::Value    value = generate_value(node->expr);
+	if (node->global) {
+	    env.slots[node->slot] = value;
+	} else {
+	    stack[bp + node->slot] = value;
 	}
-	else
-	env.variables[node->name] = value;
+    } break;
+    case StmtKind::Return: {
+	auto    node  = std::get<NodeReturn*>(n->stmt);
+	Exprptr value = node->value;
+	if (value && value->kind == ExprKind::Call && static_cast<NodeCall *>(value)->function >= 0) {
+	    auto ncall = static_cast<NodeCall *>(value);
+	    // Evaluate on the stack (so the values stay rooted), then move them.
+	    size_t mark = stack.size();
+	    for (auto arg : ncall->args) {
+		Value::Value v = generate_value(arg);
+		stack.push_back(v);
+	    }
+	    tail_args.assign(stack.begin() + mark, stack.end());
+	    stack.resize(mark);
+	    tail_call = program.functions[ncall->function];
+	} else {
+	    return_value = value ? generate_value(value) : Value::Value::nil();
+	}
+	returning = true;
     } break;
     case StmtKind::Expr: {
 	auto expr = std::get<NodeExprStmt*>(n->stmt);
-	Value::ValuePtr value = generate_value(expr->expr.get());
+	Value::Value value = generate_value(expr->expr);
     } break;
 default:
     break;
 }
 }
-ValuePtr Vm::generate_value(NodeExpr* expr) {
-    if (auto nint = dynamic_cast<NodeInt *>(expr)) {
-	return std::make_shared<Value::Value>(
-        Value::Value(ValueKind::Number, nint->value));
-    }
-    if (auto nstr = dynamic_cast<NodeString *>(expr)) {
-	return std::make_shared<Value::Value>(
-        Value::Value(ValueKind::String, nstr->value));
-    }
-    if (auto nbin = dynamic_cast<NodeBin *>(expr)) {
-	auto lhs  = generate_value(nbin->lhs.get());
-	auto rhs  = generate_value((nbin->rhs.get()));
-	assert(lhs->kind == Value::ValueKind::Number && rhs->kind == Value::ValueKind::Number);
-	switch (nbin->op) {
-	case BinaryOp::Add:
-	    return std::make_shared<Value::Value>(Value::Value(ValueKind::Number,
-	    std::get<int64_t>(lhs->data) + std::get<int64_t>(rhs->data)
-	    ));
-	case BinaryOp::Sub:
-	    return std::make_shared<Value::Value>(Value::Value(ValueKind::Number,
-	    std::get<int64_t>(lhs->data) - std::get<int64_t>(rhs->data)
-	    ));
-	case BinaryOp::Mul:
-	    return std::make_shared<Value::Value>(Value::Value(ValueKind::Number,
-	    std::get<int64_t>(lhs->data) * std::get<int64_t>(rhs->data)
-	    ));
-	case BinaryOp::Div:
-	    return std::make_shared<Value::Value>(Value::Value(ValueKind::Number,
-	    std::get<int64_t>(lhs->data) / std::get<int64_t>(rhs->data)
-	    ));
-	case BinaryOp::Or:
-	    return std::make_shared<Value::Value>(Value::Value(ValueKind::Number,
-	    std::get<int64_t>(lhs->data) || std::get<int64_t>(rhs->data)
-	    ));
-	case BinaryOp::And:
-	    return std::make_shared<Value::Value>(Value::Value(ValueKind::Number,
-	    std::get<int64_t>(lhs->data) && std::get<int64_t>(rhs->data)
-	    ));
+Tisp::Value::Value Vm::generate_value(NodeExpr* expr) {
+    TISP_STAT(stats.exprs[size_t(expr->kind)]++);
+    switch (expr->kind) {
+    case ExprKind::Int:
+	return heap.make_int(static_cast<NodeInt *>(expr)->value);
+    case ExprKind::String:
+	return literals.intern(static_cast<NodeString *>(expr)->value);
+    case ExprKind::Bin: {
+	// Operator chains are left-deep; walk the left spine instead of recursing.
+	size_t    mark = spine.size();
+	NodeExpr* left = expr;
+	while (left->kind == ExprKind::Bin) {
+	    spine.push_back(static_cast<NodeBin *>(left));
+	    left = static_cast<NodeBin *>(left)->lhs;
 	}
+	// The rest of the chain is evaluated here, not through a call each.
+	TISP_STAT(stats.exprs[size_t(ExprKind::Bin)] += spine.size() - mark - 1);
+	Value::Value acc = generate_value(left);
+	while (spine.size() > mark) {
+	    NodeBin* nbin = spine.back();
+	    spine.pop_back();
+	    if (nbin->op == BinaryOp::And || nbin->op == BinaryOp::Or) {
+		// Short-circuit: the right side only runs when the left doesn't decide.
+		if (!acc.is_int()) fail(nbin->span, "Operands must be numbers");
+		bool lhs = acc.as_int() != 0;
+		if (lhs == (nbin->op == BinaryOp::Or)) {
+		    acc = Value::Value::small_int(lhs);
+		    continue;
+		}
+		stack.push_back(acc);
+		Value::Value rhs = generate_value(nbin->rhs);
+		stack.pop_back();
+		if (!rhs.is_int()) fail(nbin->span, "Operands must be numbers");
+		acc = Value::Value::small_int(rhs.as_int() != 0);
+		continue;
+	    }
+	    stack.push_back(acc);
+	    Value::Value rhs = generate_value(nbin->rhs);
+	    stack.pop_back();
+	    acc = binary_value(nbin->op, acc, rhs, nbin->span);
+	}
+	return acc;
     }
-    if (auto nid = dynamic_cast<NodeIdent *>(expr)) {
-	return this->env.variables[nid->identifier];
-    }
-    if (auto ncall = dynamic_cast<NodeCall *>(expr)) {
-	return handle_call(ncall);
+    case ExprKind::Ident: {
+	auto         nid   = static_cast<NodeIdent *>(expr);
+	Value::Value value = nid->global ? env.slots[nid->slot] : stack[bp + nid->slot];
+	TISP_STAT(stats.lookups++; stats.misses += value.is_nil());
+	return value;
     }
-    if (auto nif = dynamic_cast<NodeIf *>(expr)) {
-	ValuePtr cond = generate_value(nif->condition.get());
-	if (cond->is_truthy()) {
-	    for(auto &node: nif->then_body->stmts) {
-		execute_node(node.get());
-	    }
+    case ExprKind::Call:
+	return handle_call(static_cast<NodeCall *>(expr));
+    case ExprKind::If: {
+	auto nif = static_cast<NodeIf *>(expr);
+	Value::Value cond = generate_value(nif->condition);
+	stack.push_back(cond);
+	if (cond.is_truthy()) {
+	    execute_body(nif->then_body);
 	} else if (nif->else_body) {
-	    for(auto &node: nif->else_body->stmts) {
-		execute_node(node.get());
-	    }
+	    execute_body(nif->else_body);
 	}
+	stack.pop_back();
 	return cond;
-    } if (auto nloop = dynamic_cast<NodeLoop *>(expr)) {
-	auto value   = generate_value(nloop->times.get());
-	if (value->kind == ValueKind::Number) {
-	    int64_t times = std::get<int64_t>(value->data);
-	    for (int i = 0; i < times; i++) {
-		for (auto& node: nloop->body->stmts) {
-		    execute_node(node.get());
-		}
+    }
+    case ExprKind::Loop: {
+	auto nloop = static_cast<NodeLoop *>(expr);
+	auto value   = generate_value(nloop->times);
+	if (nloop->parallel && value.kind() == ValueKind::Number) {
+	    std::vector<Value::Value> frame(nloop->frame_size);
+	    for (auto capture : nloop->captures) {
+		frame[capture.inner] = stack[bp + capture.outer];
+	    }
+	    stack.push_back(value);
+	    parallel_loop(LoopBody{nullptr, 0, nloop}, value.as_int(), frame);
+	    stack.pop_back();
+	} else if (value.kind() == ValueKind::Number) {
+	    stack.push_back(value);
+	    int64_t times = value.as_int();
+	    for (int64_t i = 0; i < times && !returning; i++) {
+		execute_body(nloop->body);
 	    }
+	    stack.pop_back();
 	}
 	return value;
     }
+    case ExprKind::Block: {
+	auto nblock = static_cast<NodeBlock *>(expr);
+	execute_body(nblock->body);
+	if (returning) {
+	    return Value::Value::nil();
+	}
+	return generate_value(nblock->value);
+    }
+    default:
+	break;
+    }
+    out.flush();
     error_manager->report(Diagnostic(DiagnosticType::Error, expr->span, "Todo: Add Error Value Type", ""), true);
     exit(1);
 }
 
 
-ValuePtr Vm::handle_call(NodeCall *call) {
-    if (auto nid = dynamic_cast<NodeIdent *>(call->callee.get())) {
-	if (this->builtins.count(nid->identifier)) {
-	    return this->builtins[nid->identifier](this,
-	    to_values(call->args));
+void Vm::fail(Span span, const char* message) {
+    out.flush();
+    error_manager->report(Diagnostic(DiagnosticType::Error, span, message, ""), true);
+}
+
+// Same checks as the bytecode VM, so both modes report the same errors.
+Tisp::Value::Value Vm::binary_value(BinaryOp op, Value::Value lhs, Value::Value rhs, Span span) {
+    if (op == BinaryOp::Eq || op == BinaryOp::Ne) {
+	return Value::Value::small_int(lhs.equals(rhs) == (op == BinaryOp::Eq));
+    }
+    if (!lhs.is_int() || !rhs.is_int()) {
+	fail(span, "Operands must be numbers");
+    }
+    int64_t r;
+    switch (op) {
+    case BinaryOp::Add:
+	if (__builtin_add_overflow(lhs.as_int(), rhs.as_int(), &r)) fail(span, "Integer overflow");
+	return heap.make_int(r);
+    case BinaryOp::Sub:
+	if (__builtin_sub_overflow(lhs.as_int(), rhs.as_int(), &r)) fail(span, "Integer overflow");
+	return heap.make_int(r);
+    case BinaryOp::Mul:
+	if (__builtin_mul_overflow(lhs.as_int(), rhs.as_int(), &r)) fail(span, "Integer overflow");
+	return heap.make_int(r);
+    case BinaryOp::Div:
+    case BinaryOp::Mod:
+	if (rhs.as_int() == 0) fail(span, "Division by zero");
+	if (rhs.as_int() == -1) {
+	    // INT64_MIN / -1 overflows and INT64_MIN % -1 traps.
+	    if (op == BinaryOp::Mod) return Value::Value::small_int(0);
+	    if (lhs.as_int() == INT64_MIN) fail(span, "Integer overflow");
 	}
+	return heap.make_int(op == BinaryOp::Div ? lhs.as_int() / rhs.as_int() : lhs.as_int() % rhs.as_int());
+    case BinaryOp::Shl:
+    case BinaryOp::Shr:
+	if (rhs.as_int() < 0 || rhs.as_int() > 63) fail(span, "Shift count out of range");
+	return heap.make_int(op == BinaryOp::Shl ? lhs.as_int() << rhs.as_int() : lhs.as_int() >> rhs.as_int());
+    case BinaryOp::Band:
+	return heap.make_int(lhs.as_int() & rhs.as_int());
+    case BinaryOp::Bor:
+	return heap.make_int(lhs.as_int() | rhs.as_int());
+    case BinaryOp::Or:
+	return heap.make_int(lhs.as_int() || rhs.as_int());
+    case BinaryOp::And:
+	return heap.make_int(lhs.as_int() && rhs.as_int());
+    case BinaryOp::Lt:
+	return Value::Value::small_int(lhs.as_int() < rhs.as_int());
+    case BinaryOp::Le:
+	return Value::Value::small_int(lhs.as_int() <= rhs.as_int());
+    case BinaryOp::Gt:
+	return Value::Value::small_int(lhs.as_int() > rhs.as_int());
+    case BinaryOp::Ge:
+	return Value::Value::small_int(lhs.as_int() >= rhs.as_int());
+    case BinaryOp::Eq:
+    case BinaryOp::Ne:
+	break;
     }
-    assert(0 && "Todo: add error value");
-    exit(1);
+    return Value::Value::nil();
 }
 
-Args Vm::to_values(std::vector<Exprptr> &args) {
-    std::vector<ValuePtr> a;
-    for (auto &arg : args) {
-	a.push_back(generate_value(arg.get()));
+Tisp::Value::Value Vm::handle_call(NodeCall *call) {
+    if (call->function >= 0) {
+	size_t base = stack.size();
+	for (auto arg : call->args) {
+	    Value::Value value = generate_value(arg);
+	    stack.push_back(value);
+	}
+	return call_function(program.functions[call->function], base, call->span);
+    }
+    if (call->native < 0) {
+	out.flush();
+	error_manager->report(Diagnostic(DiagnosticType::Error, call->callee->span, "Unknown function", ""), true);
     }
-    return a;
+    // Arguments are evaluated onto the value stack and passed as a view of it.
+    size_t base = stack.size();
+    for (auto arg : call->args) {
+	Value::Value value = generate_value(arg);
+	stack.push_back(value);
+    }
+    Value::Value result = call_native(call->native, Args(stack.data() + base, stack.size() - base), call->span);
+    stack.resize(base);
+    return result;
 }
+
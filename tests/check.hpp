@@ -0,0 +1,20 @@
+#pragma once
+
+// Minimal checks for the programs in this directory. A failed CHECK is
+// printed and counted; main returns finish(), non-zero after any failure.
+#include <cstdio>
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+	if (!(cond)) { \
+	    std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+	    failures++; \
+	} \
+    } while (0)
+
+inline int finish(const char* name) {
+    std::printf("%s: %s\n", name, failures ? "FAILED" : "ok");
+    return failures != 0;
+}
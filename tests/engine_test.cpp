@@ -0,0 +1,53 @@
+// Script errors reach an embedder as DiagnosticError, from natives called
+// with bad arguments as well as from operators, and never abort the host.
+#include <check.hpp>
+#include <engine.hpp>
+#include <string>
+
+using namespace Tisp;
+
+// The message of the error running `source` throws, or "" if it doesn't.
+static std::string run_error(const std::string& source, bool jit = true) {
+    Engine  engine;
+    Isolate isolate(engine.compile("<test>", source));
+    isolate.jit = jit;
+    try {
+	isolate.run();
+    } catch (const DiagnosticError& error) {
+	return error.diagnostic.message;
+    }
+    return "";
+}
+
+int main() {
+    CHECK(run_error("exec(1);") == "exec expects one command string");
+    CHECK(run_error("exec(\"true\", \"true\");") == "exec expects one command string");
+    CHECK(run_error("spawn(3);") == "spawn expects a command string");
+    CHECK(run_error("wait(42);") == "Expected a process handle from spawn");
+    CHECK(run_error("stdout(\"x\");") == "Expected a process handle from spawn");
+    CHECK(run_error("exec_all(\"true\");") == "exec_all expects a job limit, then command strings");
+    CHECK(run_error("exec_all(2, \"true\", 5);") == "exec_all expects a job limit, then command strings");
+    CHECK(run_error("println(1 - \"a\");") == "Operands must be numbers");
+    CHECK(run_error("let a = 0; println(7 % a);") == "Division by zero");
+    CHECK(run_error("println(exec(\"true\"));") == "");
+
+    // exec's child writes into the Isolate's output, in order.
+    {
+	Engine  engine;
+	Isolate isolate(engine.compile("<test>", "println(1); println(exec(\"echo child\")); println(2);"));
+	CHECK(isolate.run() == "1 \nchild\n0 \n2 \n");
+    }
+
+    // The Isolate is still usable after an error.
+    Engine  engine;
+    Isolate isolate(engine.compile("<test>", "spawn();"));
+    for (int i = 0; i < 2; i++) {
+	try {
+	    isolate.run();
+	    CHECK(false);
+	} catch (const DiagnosticError& error) {
+	    CHECK(error.diagnostic.message == "spawn expects a command string");
+	}
+    }
+    return finish("engine_test");
+}
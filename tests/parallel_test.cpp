@@ -0,0 +1,55 @@
+// Values captured by a `ploop` are copied into each worker's heap. Strings
+// copied that way must still equal the same literal written in the loop
+// body, on the bytecode VM (with and without the JIT) and the tree-walker.
+#include <check.hpp>
+#include <cstdlib>
+#include <engine.hpp>
+#include <module.hpp>
+#include <resolver.hpp>
+#include <string>
+#include <vm.hpp>
+
+using namespace Tisp;
+
+static const char* script =
+    "let s = \"hello world long\";\n"
+    "let t = \"short\";\n"
+    "ploop 4 as i:\n"
+    "    println(i, s == \"hello world long\", s != \"hello world long\", t == \"short\", s == \"other string here\");\n"
+    "end\n";
+
+static const char* expected =
+    "0 1 0 1 0 \n"
+    "1 1 0 1 0 \n"
+    "2 1 0 1 0 \n"
+    "3 1 0 1 0 \n";
+
+static std::string tree_walk(const char* source) {
+    SourceManager sources;
+    int           file = sources.add("<test>", source);
+    ErrorManager  errors(&sources);
+    errors.throw_errors = true;
+    Language::ModuleLoader loader(&sources, &errors);
+    Language::Node         program = loader.load(file);
+    Language::Resolver     resolver(&errors);
+    resolver.resolve(program);
+    std::string output;
+    {
+	Runtime::Vm vm(std::move(program), &errors);
+	vm.out.sink = &output;
+	vm.execute();
+	vm.out.flush();
+    }
+    return output;
+}
+
+int main() {
+    setenv("TISP_THREADS", "4", 1);
+    Engine  engine;
+    Isolate isolate(engine.compile("<test>", script));
+    CHECK(isolate.run() == expected);
+    isolate.jit = false;
+    CHECK(isolate.run() == expected);
+    CHECK(tree_walk(script) == expected);
+    return finish("parallel_test");
+}
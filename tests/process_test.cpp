@@ -0,0 +1,64 @@
+// Children that fill both pipes must not deadlock the ProcessTable. Each
+// writes well past the pipe buffer to stdout and then to stderr, which
+// only completes if the parent keeps draining both. A hang is turned into
+// a failure by alarm().
+#include <check.hpp>
+#include <process.hpp>
+#include <unistd.h>
+
+using namespace Tisp::Runtime;
+
+// Stdout stays open but idle while stderr fills: a parent that reads
+// stdout until it would block never gets to stderr.
+static const char* idle_stdout =
+    "dd if=/dev/zero bs=16384 count=1 2>/dev/null; sleep 0.2; head -c 100000 /dev/zero >&2";
+
+static const char* both_pipes =
+    "head -c 200000 /dev/zero; head -c 200000 /dev/zero >&2; "
+    "head -c 70000 /dev/zero; head -c 70000 /dev/zero >&2";
+
+int main() {
+    alarm(20);
+
+    {
+	ProcessTable table;
+	int          handle = table.spawn({"/bin/sh", "-c", idle_stdout}, true);
+	CHECK(table.wait(handle) == 0);
+	CHECK(table.procs[handle].out.size() == 16384);
+	CHECK(table.procs[handle].err.size() == 100000);
+    }
+
+    {
+	ProcessTable table;
+	int          handle = table.spawn({"/bin/sh", "-c", both_pipes}, true);
+	CHECK(table.wait(handle) == 0);
+	CHECK(table.procs[handle].out.size() == 270000);
+	CHECK(table.procs[handle].err.size() == 270000);
+    }
+
+    // Several at once, as exec_all runs them.
+    {
+	ProcessTable     table;
+	std::vector<int> handles;
+	for (int i = 0; i < 4; i++) {
+	    handles.push_back(table.spawn({"/bin/sh", "-c", both_pipes}, true));
+	}
+	for (int handle : handles) {
+	    CHECK(table.wait(handle) == 0);
+	    CHECK(table.procs[handle].out.size() == 270000);
+	    CHECK(table.procs[handle].err.size() == 270000);
+	}
+    }
+    // Released slots are reused, so exec() in a loop doesn't grow the table.
+    {
+	ProcessTable table;
+	for (int i = 0; i < 50; i++) {
+	    int handle = table.spawn({"/bin/sh", "-c", "echo hi"}, true);
+	    CHECK(table.wait(handle) == 0);
+	    CHECK(table.procs[handle].out == "hi\n");
+	    table.release(handle);
+	}
+	CHECK(table.procs.size() == 1);
+    }
+    return finish("process_test");
+}